@@ -10,8 +10,14 @@
 #include <variant>
 #include <array>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <optional>
+#include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <functional>
 #include "btree.h"
 #include "phmap.h"
 #include "source_loc.hpp"
@@ -66,6 +72,7 @@ namespace HulaScript {
 				IS_NUMERICAL = 64,
 				RATIONAL_IS_NEGATIVE = 128,
 				FUNCTION_IS_VARIADIC = 256,
+				STRING_IS_INLINE = 512,
 			};
 
 			uint16_t flags;
@@ -83,6 +90,34 @@ namespace HulaScript {
 
 			value(vtype t, uint16_t flags, uint32_t function_id, size_t data) : type(t), flags(flags), function_id(function_id), data({ .id = data }) { }
 
+			//short strings are stored in function_id and data, which are contiguous
+			//the last byte holds the unused capacity, so a full inline string is still null terminated
+			static constexpr size_t INLINE_STR_CAPACITY = sizeof(uint32_t) + sizeof(size_t) - 1;
+
+			const char* inline_chars() const noexcept {
+				return reinterpret_cast<const char*>(&function_id);
+			}
+
+			static value inline_string(const char* chars, size_t length) noexcept {
+				value to_ret(vtype::STRING, vflags::STRING_IS_INLINE, 0, 0);
+				char* dest = reinterpret_cast<char*>(&to_ret.function_id);
+				std::memcpy(dest, chars, length);
+				dest[INLINE_STR_CAPACITY] = static_cast<char>(INLINE_STR_CAPACITY - length);
+				return to_ret;
+			}
+
+			std::string_view chars_view() const noexcept {
+				if (flags & vflags::STRING_IS_INLINE) {
+					return std::string_view(inline_chars(), INLINE_STR_CAPACITY - static_cast<size_t>(inline_chars()[INLINE_STR_CAPACITY]));
+				}
+				return std::string_view(data.str, gc_string::from_chars(data.str)->length);
+			}
+
+			//every string has exactly one representation: inline when short, otherwise the interned copy
+			bool same_string(const value& other) const noexcept {
+				return flags == other.flags && function_id == other.function_id && data.id == other.data.id;
+			}
+
 			friend class instance;
 		public:
 			value() : value(vtype::NIL, vflags::NONE, 0, 0) { }
@@ -126,7 +161,13 @@ namespace HulaScript {
 
 			std::string str(instance& instance) const {
 				expect_type(vtype::STRING, instance);
-				return std::string(data.str);
+				return std::string(chars_view());
+			}
+
+			//borrows the characters of a string without copying them; only valid while this value and the string are alive
+			std::string_view str_view(instance& instance) const {
+				expect_type(vtype::STRING, instance);
+				return chars_view();
 			}
 
 			const int64_t index(int64_t min, int64_t max, instance& instance) const;
@@ -157,11 +198,20 @@ namespace HulaScript {
 					payload = data.foreign_object->compute_hash();
 					break;
 				case vtype::STRING: {
+					size_t str_hash;
+					if (flags & vflags::STRING_IS_INLINE) {
+						std::string_view chars = chars_view();
+						str_hash = Hash::dj2b(chars.data(), chars.size());
+					}
+					else {
+						str_hash = gc_string::from_chars(data.str)->hash;
+					}
+
 					if constexpr (IsTableHash) {
-						return Hash::dj2b(data.str);
+						return str_hash;
 					}
 					else {
-						payload = Hash::dj2b(data.str);
+						payload = str_hash;
 						break;
 					}
 				}
@@ -196,6 +246,7 @@ namespace HulaScript {
 
 			friend class ffi_table_helper;
 		};
+		static_assert(offsetof(value, data) == offsetof(value, function_id) + sizeof(uint32_t), "Inline strings require function_id and data to be contiguous.");
 
 		class foreign_object {
 		protected:
@@ -222,51 +273,114 @@ namespace HulaScript {
 				return (size_t)this;
 			}
 
+			//only called on objects tagged GC_KIND_WEAK, after marking; drops every held value is_alive reports as dead
+			virtual void clear_dead_references(const std::function<bool(const value&)>& is_alive) { }
+
+			enum gc_kind : uint8_t {
+				GC_KIND_OBJECT,
+				GC_KIND_IMPORTED_LIBRARY, //swept after every other object, since their code may live in the library
+				GC_KIND_POOLED, //memory is recycled by the instance's foreign object pool
+				GC_KIND_WEAK //holds values without keeping them alive
+			};
+			gc_kind gc_tag = gc_kind::GC_KIND_OBJECT;
+
 			friend class instance;
+		private:
+			//intrusive registry header; the SDK's copy of foreign_object must keep the same layout
+			foreign_object* gc_next = nullptr;
+			uint32_t gc_mark = 0;
+			uint8_t gc_pool_class = 0;
 		public:
 			virtual ~foreign_object() = default;
 		};
 
 		typedef value(*custom_numerical_parser)(std::string numerical_str, const instance& instance);
 
-		std::variant<value, std::vector<compilation_error>, std::monostate> run(std::string source, std::optional<std::string> file_name, bool repl_mode = true);
-		std::optional<value> run_no_warnings(std::string source, std::optional<std::string> file_name, bool repl_mode = true);
+		static constexpr uint8_t MAX_OPTIMIZATION_LEVEL = 2;
+
+		//optimization_level 0 emits code as written, 1 removes unreachable code, threads jumps and drops values pushed only to be discarded, 2 also folds constant arithmetic
+		std::variant<value, std::vector<compilation_error>, std::monostate> run(std::string source, std::optional<std::string> file_name, bool repl_mode = true, uint8_t optimization_level = MAX_OPTIMIZATION_LEVEL);
+		std::optional<value> run_no_warnings(std::string source, std::optional<std::string> file_name, bool repl_mode = true, uint8_t optimization_level = MAX_OPTIMIZATION_LEVEL);
 		std::optional<value> run_loaded();
 
-		value load_module_from_source(std::string source, std::string file_name);
+		value load_module_from_source(std::string_view source, std::string file_name);
+		//loads a module by it's canonical path; compiled modules are shared between instances until the file is modified
+		value load_module_from_file(std::string path);
+		//compiles a module file on a scratch instance and shares it's bytecode process-wide, so importing it afterwards only links it
+		//this instance isn't touched, so modules can be compiled concurrently on other threads while it keeps running
+		bool compile_module_file(std::string path) const;
 
 		HULASCRIPT_FUNCTION std::string get_value_print_string(value to_print);
 		HULASCRIPT_FUNCTION std::string rational_to_string(value& rational, bool print_as_frac);
 
 		HULASCRIPT_FUNCTION value add_foreign_object(std::unique_ptr<foreign_object>&& foreign_obj) {
-			value to_ret = value(foreign_obj.get());
-			foreign_objs.insert(std::move(foreign_obj));
-			return to_ret;
+			foreign_object* obj = foreign_obj.release();
+			obj->gc_next = foreign_objs;
+			foreign_objs = obj;
+			allocated_since_collect += sizeof(foreign_object);
+			return value(obj);
+		}
+
+		//constructs a built-in foreign object in memory recycled from dead objects of the same size class
+		template<typename object_type, typename ... arg_types>
+		value add_pooled_foreign_object(arg_types&&... args) {
+			if constexpr (sizeof(object_type) > POOL_CLASS_SIZE * POOL_CLASS_COUNT) {
+				return add_foreign_object(std::make_unique<object_type>(std::forward<arg_types>(args)...));
+			}
+			else {
+				uint8_t pool_class = static_cast<uint8_t>((sizeof(object_type) - 1) / POOL_CLASS_SIZE);
+				std::vector<void*>& pool = foreign_object_pool[pool_class];
+
+				void* memory;
+				if (pool.empty()) {
+					memory = ::operator new((pool_class + 1) * POOL_CLASS_SIZE);
+				}
+				else {
+					memory = pool.back();
+					pool.pop_back();
+				}
+
+				foreign_object* obj;
+				try {
+					obj = new (memory) object_type(std::forward<arg_types>(args)...);
+				}
+				catch (...) {
+					pool.push_back(memory);
+					throw;
+				}
+				obj->gc_tag = foreign_object::gc_kind::GC_KIND_POOLED;
+				allocated_since_collect += sizeof(object_type);
+				obj->gc_pool_class = pool_class;
+				obj->gc_next = foreign_objs;
+				foreign_objs = obj;
+				return value(obj);
+			}
 		}
 
 		HULASCRIPT_FUNCTION value add_permanent_foreign_object(std::unique_ptr<foreign_object>&& foreign_obj) {
-			value to_ret = value(foreign_obj.get());
-			//permanent_foreign_objs.insert(foreign_obj.get());
-			temp_gc_exempt.push_back(to_ret);
-			foreign_objs.insert(std::move(foreign_obj));
+			value to_ret = add_foreign_object(std::move(foreign_obj));
+			permanent_foreign_objs[to_ret.data.foreign_object].push_back(add_root(to_ret));
 			return to_ret;
 		}
 
 		HULASCRIPT_FUNCTION value add_permanent_foreign_object(foreign_object* foreign_obj) {
 			value to_ret = value(foreign_obj);
-			//permanent_foreign_objs.insert(foreign_obj);
-			temp_gc_exempt.push_back(to_ret);
+			permanent_foreign_objs[foreign_obj].push_back(add_root(to_ret));
 			return to_ret;
 		}
 
 		HULASCRIPT_FUNCTION bool remove_permanent_foreign_object(foreign_object* foreign_obj) {
-			for (auto it = temp_gc_exempt.begin(); it != temp_gc_exempt.end(); it++) {
-				if (it->check_type(value::vtype::FOREIGN_OBJECT) && it->data.foreign_object == foreign_obj) {
-					it = temp_gc_exempt.erase(it);
-					return true;
-				}
+			auto it = permanent_foreign_objs.find(foreign_obj);
+			if (it == permanent_foreign_objs.end()) {
+				return false;
 			}
-			return false;
+
+			remove_root(it->second.back());
+			it->second.pop_back();
+			if (it->second.empty()) {
+				permanent_foreign_objs.erase(it);
+			}
+			return true;
 		}
 
 		HULASCRIPT_FUNCTION value make_foreign_function(std::function<value(std::vector<value>& arguments, instance& instance)> function) {
@@ -284,14 +398,19 @@ namespace HulaScript {
 		}
 
 		HULASCRIPT_FUNCTION value make_string(std::string str) {
-			auto res = active_strs.insert(std::unique_ptr<char[]>(new char[str.size() + 1]));
-			std::strcpy(res.first->get(), str.c_str());
-			return value(res.first->get());
+			if (str.size() <= value::INLINE_STR_CAPACITY) {
+				return value::inline_string(str.data(), str.size());
+			}
+
+			gc_string* alloc = allocate_string(str.size());
+			std::memcpy(alloc->chars(), str.data(), str.size());
+			alloc->seal();
+			return intern_string(alloc);
 		}
 
 		HULASCRIPT_FUNCTION value make_table_obj(const std::vector<std::pair<std::string, value>>& elems, bool is_final=false) {
 			size_t table_id = allocate_table(elems.size(), false);
-			table& table = tables.at(table_id);
+			table& table = get_table(table_id);
 			for (size_t i = 0; i < elems.size(); i++) {
 				table.key_hashes.insert({ Hash::dj2b(elems[i].first.c_str()), i });
 				heap[table.block.start + i] = elems[i].second;
@@ -303,7 +422,7 @@ namespace HulaScript {
 
 		HULASCRIPT_FUNCTION value make_array(const std::vector<value>& elems, bool is_final = false) {
 			size_t table_id = allocate_table(elems.size(), false);
-			table& table = tables.at(table_id);
+			table& table = get_table(table_id);
 			for (size_t i = 0; i < elems.size(); i++) {
 				table.key_hashes.insert({ rational_integer(i).hash<true>(), i });
 				heap[table.block.start + i] = elems[i];
@@ -314,6 +433,8 @@ namespace HulaScript {
 		}
 
 		HULASCRIPT_FUNCTION value parse_rational(std::string src) const;
+		//like parse_rational, but returns nothing instead of panicking when src isn't a valid rational
+		std::optional<value> try_parse_rational(std::string_view src) const noexcept;
 
 		value parse_number(std::string src) const {
 			return numerical_parser(src, *this);
@@ -345,12 +466,164 @@ namespace HulaScript {
 			temp_gc_exempt.pop_back();
 		}
 
+		//roots a value until remove_root is called with the returned slot; unlike temp_gc_protect, roots can be removed in any order
+		HULASCRIPT_FUNCTION uint32_t add_root(value val) {
+			if (free_root_slots.empty()) {
+				root_slots.push_back(val);
+				root_slot_used.push_back(true);
+				return static_cast<uint32_t>(root_slots.size() - 1);
+			}
+
+			uint32_t slot = free_root_slots.back();
+			free_root_slots.pop_back();
+			root_slots[slot] = val;
+			root_slot_used[slot] = true;
+			return slot;
+		}
+
+		HULASCRIPT_FUNCTION void remove_root(uint32_t slot) {
+			assert(slot < root_slots.size() && root_slot_used[slot]); //removing a root twice would hand the slot out to two handles
+			root_slots[slot] = value();
+			root_slot_used[slot] = false;
+			free_root_slots.push_back(slot);
+		}
+
+		HULASCRIPT_FUNCTION value& root_at(uint32_t slot) {
+			assert(slot < root_slots.size() && root_slot_used[slot]);
+			return root_slots[slot];
+		}
+
+		//keeps a value alive until the end of the enclosing scope
+		class local_handle {
+		public:
+			local_handle(instance& owner_instance, value val) : owner_instance(owner_instance), slot(owner_instance.add_root(val)) { }
+
+			local_handle(const local_handle& other) = delete;
+			local_handle& operator=(const local_handle& other) = delete;
+			static void* operator new(size_t size) = delete;
+
+			~local_handle() {
+				owner_instance.remove_root(slot);
+			}
+
+			value get() const {
+				return owner_instance.root_at(slot);
+			}
+
+			void set(value val) {
+				owner_instance.root_at(slot) = val;
+			}
+		private:
+			instance& owner_instance;
+			uint32_t slot;
+		};
+
+		//keeps a value alive until the handle is reset or destroyed; it can be moved and stored, and must not outlive its instance
+		class persistent_handle {
+		public:
+			persistent_handle() : owner_instance(nullptr), slot(0) { }
+			persistent_handle(instance& owner_instance, value val) : owner_instance(&owner_instance), slot(owner_instance.add_root(val)) { }
+
+			persistent_handle(persistent_handle&& other) noexcept : owner_instance(other.owner_instance), slot(other.slot) {
+				other.owner_instance = nullptr;
+			}
+
+			persistent_handle& operator=(persistent_handle&& other) noexcept {
+				if (this != &other) {
+					reset();
+					owner_instance = other.owner_instance;
+					slot = other.slot;
+					other.owner_instance = nullptr;
+				}
+				return *this;
+			}
+
+			persistent_handle(const persistent_handle& other) = delete;
+			persistent_handle& operator=(const persistent_handle& other) = delete;
+
+			~persistent_handle() {
+				reset();
+			}
+
+			bool empty() const noexcept {
+				return owner_instance == nullptr;
+			}
+
+			value get() const {
+				return empty() ? value() : owner_instance->root_at(slot);
+			}
+
+			void set(value val) {
+				assert(!empty());
+				owner_instance->root_at(slot) = val;
+			}
+
+			void reset() {
+				if (owner_instance != nullptr) {
+					owner_instance->remove_root(slot);
+					owner_instance = nullptr;
+				}
+			}
+		private:
+			instance* owner_instance;
+			uint32_t slot;
+		};
+
+		//a script compiled once by prepare; executing it again skips tokenizing, compiling and the collection that ends a run
+		class script_handle {
+		public:
+			script_handle() : owner_instance(nullptr) { }
+
+			bool empty() const noexcept {
+				return script.empty();
+			}
+
+			value execute(std::vector<value> arguments = {}) {
+				assert(!empty());
+				return owner_instance->execute_prepared(script.get(), arguments);
+			}
+		private:
+			script_handle(instance& owner_instance, value script) : owner_instance(&owner_instance), script(owner_instance, script) { }
+
+			instance* owner_instance;
+			persistent_handle script; //the compiled script, rooted as a closure
+
+			friend class instance;
+		};
+
+		//compiles source as the body of a function taking parameters, which only sees globals; the script returns it's result with return
+		script_handle prepare(std::string source, std::vector<std::string> parameters = {}, std::optional<std::string> file_name = std::nullopt);
+
+		//after a run, only collect once at least this many bytes were allocated since the last collection
+		void set_post_run_collect_threshold(size_t bytes) noexcept {
+			post_run_collect_threshold = bytes;
+		}
+
+		//collects garbage right away; must not be called while the instance is running
+		void collect_garbage() noexcept {
+			garbage_collect();
+		}
+
+		//tables with at least this many elements get a mapping of their own, which is never moved by compaction
+		void set_large_table_threshold(size_t capacity) noexcept {
+			large_table_threshold = std::max(capacity, segmented_heap::SLOT_SIZE);
+		}
+
+		//when enabled, import reuses the bytecode cached in a .hsc file next to the module, and rewrites the file once it's stale
+		void set_module_cache(bool enabled) noexcept {
+			module_cache_enabled = enabled;
+		}
+
+		//when enabled, top-level functions that can't capture variables and class methods are compiled when they're first called
+		//modules only compile lazily while the module cache is disabled, since a cached module must include every function's code
+		void set_lazy_compile(bool enabled) noexcept {
+			lazy_compile_enabled = enabled;
+		}
+
 		instance(custom_numerical_parser numerical_parser);
 		instance();
 
-#ifdef HULASCRIPT_USE_SHARED_LIBRARY
 		~instance();
-#endif // HULASCRIPT_USE_SHARED_LIBRARY
 
 		instance(const instance& other) = delete;
 		instance& operator=(const instance& other) = delete;
@@ -396,6 +669,7 @@ namespace HulaScript {
 			ALLOCATE_INHERITED_CLASS,
 			ALLOCATE_MODULE,
 			FINALIZE_TABLE,
+			RELEASE_LOCAL_TABLE, //frees a table literal that never escaped the local it was stored in
 			LOAD_MODULE,
 			STORE_MODULE,
 
@@ -449,17 +723,317 @@ namespace HulaScript {
 			gc_block(size_t start, size_t capacity) : start(start), capacity(capacity) { }
 		};
 
+		//where elements of tables are stored; grows by adding chunks, so existing elements are never copied when it grows
+		//large objects get a dedicated mapping of their own, which is never moved and is unmapped as soon as it's freed
+		class segmented_heap {
+		public:
+			static constexpr size_t SLOT_BITS = 8;
+			static constexpr size_t SLOT_SIZE = 1 << SLOT_BITS;
+			static constexpr size_t MAX_CHUNK_SIZE = 1 << 16;
+
+			segmented_heap() = default;
+			segmented_heap(const segmented_heap& other) = delete;
+			~segmented_heap();
+
+			value& operator[](size_t address) noexcept {
+				return slots[address >> SLOT_BITS][address & (SLOT_SIZE - 1)];
+			}
+
+			//address of the next element that will be allocated
+			const size_t size() const noexcept {
+				return top;
+			}
+
+			//elements that can be allocated before another chunk is needed
+			const size_t available() const noexcept {
+				return top_end - top;
+			}
+
+			//elements held by chunks and large objects
+			const size_t committed() const noexcept {
+				return chunk_elems_count + large_elems_count;
+			}
+
+			const size_t chunk_elems() const noexcept {
+				return chunk_elems_count;
+			}
+
+			const size_t chunk_count() const noexcept {
+				return chunks.size();
+			}
+
+			//chunks are kept sorted by address
+			gc_block chunk_at(size_t index) const noexcept {
+				return gc_block(chunks[index].start, chunks[index].capacity);
+			}
+
+			size_t allocate(size_t capacity) noexcept {
+				assert(capacity <= available());
+				size_t start = top;
+				top += capacity;
+				return start;
+			}
+
+			//adds a new chunk that can hold at least capacity elements, and allocates from it from now on
+			void grow(size_t capacity) {
+				size_t chunk_capacity = std::max(capacity, std::min(std::max(chunk_elems_count, SLOT_SIZE), MAX_CHUNK_SIZE));
+				chunk_capacity = round_to_slot(chunk_capacity);
+
+				chunk new_chunk = { .elems = std::unique_ptr<value[]>(new value[chunk_capacity]), .start = 0, .capacity = chunk_capacity };
+				new_chunk.start = reserve_slots(new_chunk.elems.get(), chunk_capacity);
+				top = new_chunk.start;
+				top_end = new_chunk.start + chunk_capacity;
+				chunk_elems_count += chunk_capacity;
+
+				auto it = std::upper_bound(chunks.begin(), chunks.end(), new_chunk.start, [](size_t start, const chunk& chunk) -> bool {
+					return start < chunk.start;
+				});
+				chunks.insert(it, std::move(new_chunk));
+			}
+
+			//maps a dedicated region for capacity elements; returns it's start address
+			size_t allocate_large(size_t capacity);
+			void free_large(size_t address);
+
+			//empty blocks are never large, even if they happen to start where a large object does
+			bool is_chunk_start(size_t address) const noexcept {
+				auto it = std::lower_bound(chunks.begin(), chunks.end(), address, [](const chunk& chunk, size_t address) -> bool {
+					return chunk.start < address;
+				});
+				return it != chunks.end() && it->start == address;
+			}
+
+			//grows the allocation ending at end in place, if it's the most recent one and the current chunk has room
+			bool try_extend(size_t end, size_t extra) noexcept {
+				if (end != top || extra > available()) {
+					return false;
+				}
+				top += extra;
+				return true;
+			}
+
+			//gives back everything from new_top up to the current top to the bump allocator
+			void retract(size_t new_top) noexcept {
+				assert(new_top <= top);
+				top = new_top;
+			}
+
+			bool is_large(const gc_block& block) const noexcept {
+				return block.capacity > 0 && large_objects.contains(block.start);
+			}
+
+			//moves elements between two ranges that are each contiguous
+			void move(size_t src, size_t dest, size_t count) noexcept {
+				if (count == 0) {
+					return;
+				}
+				value* src_ptr = &(*this)[src];
+				std::move(src_ptr, src_ptr + count, &(*this)[dest]);
+			}
+
+			//releases every chunk after chunk_index, and continues allocating from new_top within chunk_index
+			void truncate(size_t chunk_index, size_t new_top) {
+				while (chunks.size() > chunk_index + 1) {
+					release_slots(chunks.back().start, chunks.back().capacity);
+					chunk_elems_count -= chunks.back().capacity;
+					chunks.pop_back();
+				}
+				top = new_top;
+				top_end = chunks.empty() ? new_top : chunks.back().start + chunks.back().capacity;
+			}
+		private:
+			struct chunk {
+				std::unique_ptr<value[]> elems;
+				size_t start;
+				size_t capacity;
+			};
+
+			struct large_object {
+				value* elems;
+				size_t capacity;
+			};
+
+			std::vector<chunk> chunks;
+			phmap::btree_map<size_t, large_object> large_objects;
+
+			std::vector<value*> slots;
+			phmap::btree_map<size_t, size_t> free_slots; //first free slot, followed by the length of the run
+
+			size_t top = 0;
+			size_t top_end = 0;
+			size_t chunk_elems_count = 0;
+			size_t large_elems_count = 0;
+
+			static const size_t round_to_slot(size_t capacity) noexcept {
+				return (capacity + SLOT_SIZE - 1) & ~(SLOT_SIZE - 1);
+			}
+
+			//points a run of slots at elems; returns the address of the first element
+			size_t reserve_slots(value* elems, size_t capacity) {
+				size_t needed = capacity >> SLOT_BITS;
+				size_t first = slots.size();
+				for (auto it = free_slots.begin(); it != free_slots.end(); it++) {
+					if (it->second >= needed) {
+						first = it->first;
+						size_t remaining = it->second - needed;
+						free_slots.erase(it);
+						if (remaining > 0) {
+							free_slots.insert({ first + needed, remaining });
+						}
+						break;
+					}
+				}
+
+				if (first == slots.size()) {
+					slots.resize(slots.size() + needed, nullptr);
+				}
+				for (size_t i = 0; i < needed; i++) {
+					slots[first + i] = elems + (i << SLOT_BITS);
+				}
+				return first << SLOT_BITS;
+			}
+
+			//returns a run of slots, merging it with neighbouring free runs
+			void release_slots(size_t address, size_t capacity) {
+				size_t first = address >> SLOT_BITS;
+				size_t count = capacity >> SLOT_BITS;
+				std::fill(slots.begin() + first, slots.begin() + first + count, nullptr);
+
+				auto next = free_slots.find(first + count);
+				if (next != free_slots.end()) {
+					count += next->second;
+					free_slots.erase(next);
+				}
+				auto prev = free_slots.lower_bound(first);
+				if (prev != free_slots.begin()) {
+					prev--;
+					if (prev->first + prev->second == first) {
+						first = prev->first;
+						count += prev->second;
+						free_slots.erase(prev);
+					}
+				}
+
+				if (first + count == slots.size()) {
+					slots.resize(first);
+				}
+				else {
+					free_slots.insert({ first, count });
+				}
+			}
+		};
+
+		//header placed in front of the characters of every string the instance owns
+		struct gc_string {
+			uint32_t length;
+			uint32_t gc_mark;
+			size_t hash;
+
+			static constexpr uint32_t FREE_MARK = UINT32_MAX; //mark of an arena slot that holds no string
+
+			char* chars() noexcept {
+				return reinterpret_cast<char*>(this + 1);
+			}
+
+			const char* chars() const noexcept {
+				return reinterpret_cast<const char*>(this + 1);
+			}
+
+			static gc_string* from_chars(char* chars) noexcept {
+				return reinterpret_cast<gc_string*>(chars) - 1;
+			}
+
+			//terminates the string and caches it's hash; call once the characters are written
+			void seal() noexcept {
+				chars()[length] = '\0';
+				hash = Hash::dj2b(chars(), length);
+			}
+		};
+
+		//packs strings into pages of equally sized slots, so most strings never reach malloc, and empty pages are released in bulk by the sweep
+		class string_arena {
+		public:
+			string_arena() = default;
+			string_arena(const string_arena& other) = delete;
+			~string_arena();
+
+			gc_string* allocate(size_t length) {
+				size_t slot_size = sizeof(gc_string) + length + 1;
+				if (slot_size > SLOT_SIZES[SIZE_CLASS_COUNT - 1]) {
+					return allocate_large(length);
+				}
+
+				size_t size_class = 0;
+				while (SLOT_SIZES[size_class] < slot_size) {
+					size_class++;
+				}
+				if (free_slots[size_class] == nullptr) {
+					add_page(size_class);
+				}
+
+				gc_string* str = free_slots[size_class];
+				free_slots[size_class] = next_free(str);
+				str->length = static_cast<uint32_t>(length);
+				str->gc_mark = 0;
+				return str;
+			}
+
+			//gives back a string nothing references yet; long strings are left for the next sweep
+			void release(gc_string* str) noexcept {
+				size_t slot_size = sizeof(gc_string) + str->length + 1;
+				if (slot_size > SLOT_SIZES[SIZE_CLASS_COUNT - 1]) {
+					return;
+				}
+
+				size_t size_class = 0;
+				while (SLOT_SIZES[size_class] < slot_size) {
+					size_class++;
+				}
+				str->gc_mark = gc_string::FREE_MARK;
+				next_free(str) = free_slots[size_class];
+				free_slots[size_class] = str;
+			}
+
+			//frees every string not marked with epoch, and releases pages left without any live strings
+			void sweep(uint32_t epoch);
+		private:
+			static constexpr size_t SIZE_CLASS_COUNT = 10;
+			static constexpr size_t SLOT_SIZES[SIZE_CLASS_COUNT] = { 32, 48, 64, 96, 128, 192, 256, 384, 512, 1024 };
+			static constexpr size_t PAGE_SIZE = 16384;
+
+			struct page {
+				std::unique_ptr<char[]> memory;
+				size_t size_class;
+			};
+
+			std::vector<page> pages;
+			std::array<gc_string*, SIZE_CLASS_COUNT> free_slots = { };
+			std::vector<gc_string*> large_strings; //strings too long for any slot get an allocation of their own
+
+			//free slots are chained through their character area
+			static gc_string*& next_free(gc_string* slot) noexcept {
+				return *reinterpret_cast<gc_string**>(slot->chars());
+			}
+
+			void add_page(size_t size_class);
+			gc_string* allocate_large(size_t length);
+		};
+
 		struct table {
 			gc_block block;
 			size_t count;
 			phmap::btree_map<size_t, size_t> key_hashes;
 
+			//incremented every time the slot is freed, so debug builds can catch stale table id's
+			uint32_t generation = 0;
+			bool is_alive = true;
+
 			table(gc_block block, size_t count=0) : block(block), count(count) { }
 		};
 
 		struct function_entry {
 			size_t start_address;
-			size_t length;
+			size_t length; //zero until a lazy function's body is compiled
 
 			std::string name;
 			operand parameter_count;
@@ -529,21 +1103,45 @@ namespace HulaScript {
 		std::vector<value> constants;
 		std::vector<uint32_t> available_constant_ids;
 		phmap::flat_hash_map<size_t, uint32_t> constant_hashes;
-		phmap::btree_set<std::unique_ptr<char[]>> active_strs;
-		phmap::btree_set<std::unique_ptr<foreign_object>> foreign_objs;
+		string_arena strings; //where the characters of every string owned by the instance are stored
+
+		struct interned_hash {
+			size_t operator()(const gc_string* str) const noexcept {
+				return str->hash;
+			}
+		};
+		struct interned_equal {
+			bool operator()(const gc_string* a, const gc_string* b) const noexcept {
+				return a->length == b->length && std::memcmp(a->chars(), b->chars(), a->length) == 0;
+			}
+		};
+		phmap::flat_hash_set<gc_string*, interned_hash, interned_equal> interned_strs; //weak set of every live string; equal strings share one allocation
+		foreign_object* foreign_objs = nullptr; //intrusive list of every foreign object owned by the instance
+		uint32_t gc_epoch = 0; //strings and foreign objects whose gc_mark equals this were reached by the current collection
+
+		static constexpr size_t POOL_CLASS_SIZE = 16;
+		static constexpr size_t POOL_CLASS_COUNT = 16;
+		std::array<std::vector<void*>, POOL_CLASS_COUNT> foreign_object_pool; //recycled memory of pooled foreign objects, by size class
 		phmap::btree_map<size_t, size_t> loaded_modules;
 
 		phmap::flat_hash_map<uint32_t, std::function<value(std::vector<value>& arguments, instance& instance)>> foreign_functions;
 		//std::vector<uint32_t> available_foreign_function_ids;
 
-		phmap::btree_multimap<size_t, gc_block> free_blocks;
-		phmap::flat_hash_map<size_t, table> tables;
+		phmap::btree_map<size_t, size_t> free_blocks; //start address of each free block, mapped to it's capacity
+		phmap::btree_set<std::pair<size_t, size_t>> free_block_sizes; //capacity and start of each free block, for best-fit lookups
+		std::vector<table> tables; //slab of table headers, indexed directly by table id
 		std::vector<size_t> available_table_ids;
-		size_t next_table_id = 0;
 
 		std::vector<value> evaluation_stack;
 
-		std::vector<value> heap; //where elements of tables are stored
+		segmented_heap heap; //where elements of tables are stored
+		size_t heap_collect_threshold = segmented_heap::MAX_CHUNK_SIZE; //heap size past which growing the heap triggers a collection
+		size_t allocated_since_collect = 0; //approximate bytes of tables, strings, foreign objects and compiled functions allocated since the last collection
+		size_t post_run_collect_threshold = 1 << 20;
+		size_t large_table_threshold = segmented_heap::MAX_CHUNK_SIZE / 4; //tables with at least this capacity are placed in the large-object space
+
+		//the heap is only compacted once more than 1/COMPACT_FREE_FRACTION of it's chunk space lies in gaps between tables
+		static constexpr size_t COMPACT_FREE_FRACTION = 4;
 		std::vector<value> locals; //where local variables are stores
 		std::vector<value> globals; //where global variables are stored; max capacity of 256
 
@@ -554,7 +1152,11 @@ namespace HulaScript {
 		std::vector<try_handler_entry> try_handlers;
 		size_t ip = 0;
 		std::vector<instruction> instructions;
-		phmap::btree_map<size_t, source_loc> ip_src_map;
+		phmap::btree_map<size_t, std::optional<source_loc>> ip_src_map; //nullopt marks code without a place in any source, like the host's call into a script
+		phmap::btree_map<size_t, size_t> free_code_blocks; //start address of each unused span of instructions, mapped to it's length
+		phmap::btree_set<std::pair<size_t, size_t>> free_code_sizes; //length and start of each unused span, for best-fit lookups
+		std::vector<std::pair<size_t, size_t>> top_level_code; //start and length of top-level code that hasn't finished running
+		std::vector<std::pair<size_t, size_t>> retired_code; //code of functions collected mid-execution, released once execution finishes
 
 		phmap::flat_hash_map<uint32_t, function_entry> functions;
 		std::vector<uint32_t> available_function_ids;
@@ -562,9 +1164,15 @@ namespace HulaScript {
 		std::vector<uint32_t> repl_used_functions;
 		std::vector<uint32_t> repl_used_constants;
 		std::vector<value> temp_gc_exempt; //stores values exempt from garbage collection for 1 cycle
+		std::vector<value> root_slots; //values rooted by add_root; free slots hold nil
+		std::vector<bool> root_slot_used; //false for slots in free_root_slots, since a rooted value may be nil too
+		std::vector<uint32_t> free_root_slots;
+		phmap::flat_hash_map<foreign_object*, std::vector<uint32_t>> permanent_foreign_objs; //root slots of each permanent foreign object
 
 		uint32_t next_function_id = 0;
 		uint32_t declared_top_level_locals = 0;
+		bool module_cache_enabled = true;
+		bool lazy_compile_enabled = false;
 		size_t call_depth = 0;
 
 		//executes instructions loaded in instructions
@@ -573,6 +1181,9 @@ namespace HulaScript {
 		//executes arbitrary_ins
 		void execute_arbitrary(const std::vector<instruction>& arbitrary_ins);
 
+		//calls a prepared script, restoring the stacks if it panics
+		value execute_prepared(value script, std::vector<value> arguments);
+
 #ifdef HULASCRIPT_USE_SHARED_LIBRARY
 		virtual std::optional<value> execute_arbitrary(const std::vector<instruction>& arbitrary_ins, const std::vector<value>& operands, bool return_value=false);
 #endif // HULASCRIPT_USE_SHARED_LIBRARY
@@ -581,12 +1192,89 @@ namespace HulaScript {
 		gc_block allocate_block(size_t capacity, bool allow_collect);
 		size_t allocate_table(size_t capacity, bool allow_collect);
 
+		//allocates a string of length characters owned by the instance; seal it once it's characters are written
+		gc_string* allocate_string(size_t length) {
+			if (length > UINT32_MAX) {
+				panic("String is too long.", ERROR_OVERFLOW);
+			}
+			allocated_since_collect += sizeof(gc_string) + length;
+			return strings.allocate(length);
+		}
+
+		//returns the interned copy of a sealed string, releasing str if an equal string already exists
+		value intern_string(gc_string* str) {
+			if (str->length <= value::INLINE_STR_CAPACITY) {
+				value inlined = value::inline_string(str->chars(), str->length);
+				strings.release(str);
+				return inlined;
+			}
+
+			auto res = interned_strs.insert(str);
+			if (!res.second) {
+				strings.release(str);
+			}
+			return value((*res.first)->chars());
+		}
+
+		//joins two strings; the result is stored inline when short enough, and interned otherwise
+		value concat_strings(std::string_view lhs, std::string_view rhs) {
+			size_t length = lhs.size() + rhs.size();
+			if (length <= value::INLINE_STR_CAPACITY) {
+				char buffer[value::INLINE_STR_CAPACITY];
+				std::memcpy(buffer, lhs.data(), lhs.size());
+				std::memcpy(buffer + lhs.size(), rhs.data(), rhs.size());
+				return value::inline_string(buffer, length);
+			}
+
+			gc_string* alloc = allocate_string(length);
+			std::memcpy(alloc->chars(), lhs.data(), lhs.size());
+			std::memcpy(alloc->chars() + lhs.size(), rhs.data(), rhs.size());
+			alloc->seal();
+			return intern_string(alloc);
+		}
+
+		//destroys a foreign object, returning it's memory to the pool if it came from there
+		void free_foreign_object(foreign_object* obj) {
+			if (obj->gc_tag == foreign_object::gc_kind::GC_KIND_POOLED) {
+				uint8_t pool_class = obj->gc_pool_class;
+				obj->~foreign_object();
+				foreign_object_pool[pool_class].push_back(obj);
+			}
+			else {
+				delete obj;
+			}
+		}
+
+		//returns a block to the free list, merging it with adjacent free blocks
+		void release_block(gc_block block);
+		void unlink_free_block(gc_block block) noexcept;
+
+		//finds room for length instructions, reusing the code of freed functions before growing instructions
+		size_t allocate_code(size_t length);
+		//frees a span of instructions along with it's source locations; live code is never moved
+		void release_code(size_t start, size_t length);
+		//releases the code of functions collected mid-execution, once nothing is executing
+		void release_retired_code();
+		//a function's entry, code and source locations are only freed by a collection, so they count toward the next one
+		void count_function_allocation(size_t length, size_t src_loc_count) noexcept {
+			allocated_since_collect += sizeof(function_entry) + length * sizeof(instruction) + src_loc_count * sizeof(source_loc);
+		}
+
+		//tries to grow a block without moving it
+		bool extend_block(gc_block& block, size_t new_capacity) noexcept;
+
 		//expands/retracts the size of a table
 		void reallocate_table(size_t table_id, size_t new_capacity, bool allow_collect);
+		void free_table(size_t table_id);
 
-		void garbage_collect(bool compact_instructions) noexcept;
+		void garbage_collect() noexcept;
 		void finalize();
 
+		table& get_table(size_t table_id) noexcept {
+			assert(table_id < tables.size() && tables[table_id].is_alive);
+			return tables[table_id];
+		}
+
 		void expect_type(value::vtype expected_type) const {
 			evaluation_stack.back().expect_type(expected_type, *this);
 		}
@@ -604,7 +1292,10 @@ namespace HulaScript {
 			size_t hash = constant.hash<false>();
 			auto it = constant_hashes.find(hash);
 			if (it != constant_hashes.end()) {
-				return it->second;
+				const value& existing = constants[it->second];
+				if (existing.type == constant.type && existing.same_string(constant)) { //hashes of different numbers may collide
+					return it->second;
+				}
 			}
 
 			if (available_constant_ids.empty()) {
@@ -635,42 +1326,27 @@ namespace HulaScript {
 		};
 
 		struct compilation_context {
+			//code of the function (or top-level) being compiled; nested blocks emit straight into it
+			struct code_buffer {
+				std::vector<instruction> instructions;
+				std::vector<std::pair<size_t, source_loc>> ip_src_map;
+			};
+
 			struct lexical_scope {
-				size_t final_ins_offset = 0;
 				size_t next_local_id;
 
 				std::vector<size_t> declared_locals;
-				std::vector<instruction> instructions;
-				std::vector<std::pair<size_t, source_loc>> ip_src_map;
-				std::vector<size_t> continue_requests;
+				std::vector<size_t> scoped_tables; //locals declared here that were initialized with a table literal
+				std::vector<size_t> continue_requests; //addresses in the function's code buffer, patched once the loop is compiled
 				std::vector<size_t> break_requests;
 				bool all_code_paths_return;
 
 				bool is_loop_block;
 
-				void add_src_loc(source_loc loc) {
-					ip_src_map.push_back(std::make_pair(instructions.size(), loc));
-				}
-
-				void merge_scope(lexical_scope& scope) {
-					scope.final_ins_offset = instructions.size();
-					instructions.insert(instructions.end(), scope.instructions.begin(), scope.instructions.end());
-					
-					ip_src_map.reserve(ip_src_map.size() + scope.ip_src_map.size());
-					for (auto& ip_src : scope.ip_src_map) {
-						ip_src_map.push_back(std::make_pair(scope.final_ins_offset + ip_src.first, ip_src.second));
-					}
-
+				void merge_scope(const lexical_scope& scope) {
 					if (!(!is_loop_block && scope.is_loop_block)) {
-						continue_requests.reserve(continue_requests.size() + scope.continue_requests.size());
-						for (size_t ip : scope.continue_requests) {
-							continue_requests.push_back(scope.final_ins_offset + ip);
-						}
-
-						break_requests.reserve(break_requests.size() + scope.break_requests.size());
-						for (size_t ip : scope.break_requests) {
-							break_requests.push_back(scope.final_ins_offset + ip);
-						}
+						continue_requests.insert(continue_requests.end(), scope.continue_requests.begin(), scope.continue_requests.end());
+						break_requests.insert(break_requests.end(), scope.break_requests.begin(), scope.break_requests.end());
 					}
 				}
 			};
@@ -697,10 +1373,18 @@ namespace HulaScript {
 
 			std::vector<function_declaration> function_decls;
 			std::vector<lexical_scope> lexical_scopes;
+			std::vector<code_buffer> code_buffers;
 			compile_mode mode = compile_mode::COMPILE_MODE_NORMAL;
 			std::optional<size_t> parent_module = std::nullopt;
+			uint8_t optimization_level = MAX_OPTIMIZATION_LEVEL;
 
 			phmap::btree_map<size_t, variable> active_variables;
+			std::shared_ptr<const phmap::btree_map<size_t, variable>> variables_snapshot; //the active variables lazy functions are compiled against, shared until another variable is declared
+			std::shared_ptr<const std::string> lazy_source; //set when eligible functions are compiled lazily; owns the tokenizer's source
+
+			//maps each local initialized with a table literal to whether the table has escaped; tables that haven't are released when their scope ends
+			phmap::flat_hash_map<size_t, bool> scoped_tables;
+			std::pair<size_t, size_t> table_literal_end = { 0, SIZE_MAX }; //scope depth and instruction address right after the last table literal
 
 			tokenizer& tokenizer;
 			std::vector<source_loc> current_src_pos;
@@ -713,8 +1397,8 @@ namespace HulaScript {
 			operand alloc_global(std::string name);
 
 			size_t emit(instruction ins) noexcept {
-				size_t i = lexical_scopes.back().instructions.size();
-				lexical_scopes.back().instructions.push_back(ins);
+				size_t i = code_buffers.back().instructions.size();
+				code_buffers.back().instructions.push_back(ins);
 				return i;
 			}
 
@@ -722,26 +1406,30 @@ namespace HulaScript {
 				if (new_operand > UINT8_MAX) {
 					panic("Cannot set operand to value larger than 255.");
 				}
-				lexical_scopes.back().instructions[addr].operand = static_cast<operand>(new_operand);
+				code_buffers.back().instructions[addr].operand = static_cast<operand>(new_operand);
 			}
 
 			void set_instruction(size_t addr, opcode operation, size_t operand) {
-				lexical_scopes.back().instructions[addr].operation = operation;
+				code_buffers.back().instructions[addr].operation = operation;
 				set_operand(addr, operand);
 			}
 
 			void set_src_loc(source_loc loc) {
 				current_src_pos.push_back(loc);
-				lexical_scopes.back().add_src_loc(loc);
+				add_src_loc(loc);
 			}
 
 			void unset_src_loc() {
 				current_src_pos.pop_back();
 				if (!current_src_pos.empty()) {
-					lexical_scopes.back().add_src_loc(current_src_pos.back());
+					add_src_loc(current_src_pos.back());
 				}
 			}
 
+			void add_src_loc(source_loc loc) {
+				code_buffers.back().ip_src_map.push_back(std::make_pair(code_buffers.back().instructions.size(), loc));
+			}
+
 			void panic(std::string msg) const {
 				throw compilation_error(msg, current_src_pos.back());
 			}
@@ -768,7 +1456,32 @@ namespace HulaScript {
 			}
 
 			void modify_ins_operand(size_t ins_adr, operand new_op) {
-				lexical_scopes.back().instructions[ins_adr].operand = new_op;
+				code_buffers.back().instructions[ins_adr].operand = new_op;
+			}
+
+			//true if the local is a scoped table of the function being compiled, that hasn't escaped yet
+			bool is_scoped_table(size_t hash) const {
+				auto it = scoped_tables.find(hash);
+				if (it == scoped_tables.end() || it->second) {
+					return false;
+				}
+				return active_variables.at(hash).func_id == function_decls.size();
+			}
+
+			void mark_escaped(size_t hash) {
+				auto it = scoped_tables.find(hash);
+				if (it != scoped_tables.end()) {
+					it->second = true;
+				}
+			}
+
+			//releases the scoped tables declared in the current scope; only reached once their uses in that scope have been compiled
+			void emit_release_scoped_tables() {
+				for (size_t hash : lexical_scopes.back().scoped_tables) {
+					if (!scoped_tables.at(hash)) {
+						emit({ .operation = opcode::RELEASE_LOCAL_TABLE, .operand = active_variables.at(hash).offset });
+					}
+				}
 			}
 
 			void emit_unwind_loop_vars() {
@@ -788,7 +1501,7 @@ namespace HulaScript {
 			}
 
 			const size_t current_ip() const noexcept {
-				return lexical_scopes.back().instructions.size();
+				return code_buffers.back().instructions.size();
 			}
 
 			void emit_function_operation(opcode op, uint32_t id) noexcept {
@@ -798,8 +1511,26 @@ namespace HulaScript {
 			}
 		};
 
+		//a function whose body is compiled when it's first called
+		struct lazy_function {
+			std::shared_ptr<const std::string> source;
+			tokenizer body; //positioned at the first token of the function's body
+			source_loc location;
+			compile_mode mode;
+			std::optional<size_t> parent_module;
+			uint8_t optimization_level;
+			std::shared_ptr<const phmap::btree_map<size_t, compilation_context::variable>> variables;
+
+			std::vector<std::string> param_names;
+			bool no_capture;
+			bool is_class_method;
+			bool is_constructor;
+			bool requires_super_call;
+		};
+
 		std::vector<size_t> top_level_local_vars;
 		std::vector<size_t> global_vars;
+		phmap::flat_hash_map<uint32_t, lazy_function> lazy_functions;
 		custom_numerical_parser numerical_parser;
 
 		void alloc_and_store_global(std::string name, compilation_context& context, bool already_allocated = false);
@@ -809,7 +1540,9 @@ namespace HulaScript {
 			context.emit_load_constant(add_constant(value(value::vtype::INTERNAL_STRHASH, value::vflags::NONE, 0, hash)), repl_used_constants);
 		}
 
-		uint32_t emit_finalize_function(compilation_context& context);
+		//when lazy_id is set, the function's stub is replaced instead of a new function being added
+		uint32_t emit_finalize_function(compilation_context& context, std::optional<uint32_t> lazy_id = std::nullopt);
+		uint32_t add_function(compilation_context& context, function_entry function);
 
 		void compile_args_and_call(compilation_context& context);
 
@@ -834,8 +1567,61 @@ namespace HulaScript {
 		void compile_try_catch(compilation_context& context);
 
 		uint32_t compile_function(compilation_context& context, std::string name, bool is_class_method=false, bool is_constructor = false, bool requires_super_call = false);
+		void compile_function_body(compilation_context& context, std::string name, const std::vector<std::string>& param_names, bool no_capture, bool is_class_method, bool is_constructor, bool requires_super_call, token_type end_token = token_type::END_BLOCK);
+		uint32_t compile_prepared(compilation_context& context, const std::vector<std::string>& parameters);
+		//compiles the body of a lazy function, returning it's start address
+		size_t compile_lazy_function(uint32_t id);
 		void compile_class(compilation_context& context);
 
 		void compile(compilation_context& context);
+
+		//OPTIMIZER
+
+		//an instruction of the code being optimized; jumps refer to the index of their target node instead of a relative offset
+		struct code_node {
+			instruction ins;
+			std::optional<instruction> payload;
+			size_t target = SIZE_MAX;
+			bool removed = false;
+
+			static bool has_payload(opcode operation) noexcept;
+			//true for jumps whose operand is an offset ahead of the jump, false for jumps back, nothing for other instructions
+			std::optional<bool> jump_direction() const noexcept;
+			bool is_unconditional_jump() const noexcept;
+			bool is_constant_load() const noexcept;
+			uint32_t constant_id() const;
+
+			//addresses of each node once encoded, followed by the address right after the code
+			static std::vector<size_t> addresses(const std::vector<code_node>& nodes);
+			//marks every node some jump lands on, including the end of the code
+			static std::vector<bool> jump_targets(const std::vector<code_node>& nodes);
+		};
+
+		//rewrites a finalized code buffer according to the context's optimization level
+		void optimize_code(compilation_context& context, compilation_context::code_buffer& code);
+		//evaluates an arithmetic operator on two numerical constants, or returns nothing if it would panic
+		std::optional<value> fold_constant_operator(opcode operation, value a, value b);
+
+		bool fold_constants(compilation_context& context, std::vector<code_node>& nodes);
+		static bool fold_constant_branches(std::vector<code_node>& nodes);
+		static bool drop_discarded_pushes(std::vector<code_node>& nodes);
+		static bool thread_jumps(std::vector<code_node>& nodes);
+		static bool remove_unreachable_code(std::vector<code_node>& nodes);
+		static bool remove_redundant_jumps(std::vector<code_node>& nodes);
+		static void compact_code(std::vector<code_node>& nodes, std::vector<std::pair<size_t, source_loc>>& src_locs);
+
+		//BYTECODE CACHE
+
+		static constexpr uint32_t MODULE_CACHE_VERSION = 2; //bump whenever the compiler emits different code for the same source
+
+		//serializes the module code at top_level, along with every function and constant it reaches, in the .hsc format
+		std::optional<std::string> serialize_module(size_t source_hash, size_t module_hash, std::pair<size_t, size_t> top_level);
+		//verifies serialized module code and links it into the instance, as if the module was just compiled
+		bool link_module(std::string_view bytecode, size_t source_hash, size_t module_hash);
+		static bool save_module_cache(const std::string& path, const std::string& bytecode);
+
+		//links the module's .hsc file or compiles it's source, leaving ip at the module's top-level code; bytecode receives what was linked, if it can be shared
+		bool prepare_module(std::string_view source, const std::string& file_name, size_t module_hash, std::string* bytecode);
+		value run_module(size_t old_ip);
 	};
 }
\ No newline at end of file
@@ -6,55 +6,73 @@
 #include "phmap.h"
 
 namespace HulaScript {
+	//methods are declared once per type by child_type's static declare_methods; every object of child_type shares the same method table
 	template<typename child_type>
 	class foreign_method_object : public instance::foreign_object {
 	public:
 		instance::value load_property(size_t name_hash, instance& instance) override {
-			auto it = method_id_lookup.find(name_hash);
-			if (it != method_id_lookup.end()) {
+			const method_table& table = get_method_table();
+			auto it = table.method_id_lookup.find(name_hash);
+			if (it != table.method_id_lookup.end()) {
 				return instance::value(it->second, static_cast<foreign_object*>(this));
 			}
 			return instance::value();
 		}
 
 		instance::value call_method(uint32_t method_id, std::vector<instance::value>& arguments, instance& instance) override {
-			if (method_id >= methods.size()) {
+			const method_table& table = get_method_table();
+			if (method_id >= table.methods.size()) {
 				return instance::value();
 			}
-			return (dynamic_cast<child_type*>(this)->*methods[method_id])(arguments, instance);
+			return (static_cast<child_type*>(this)->*table.methods[method_id])(arguments, instance);
 		}
 	protected:
-		bool declare_method(std::string name, instance::value(child_type::* method)(std::vector<instance::value>& arguments, instance& instance)) {
+		struct method_table {
+			phmap::flat_hash_map<size_t, uint32_t> method_id_lookup;
+			std::vector<instance::value(child_type::*)(std::vector<instance::value>& arguments, instance& instance)> methods;
+		};
+
+		static bool declare_method(method_table& table, std::string name, instance::value(child_type::* method)(std::vector<instance::value>& arguments, instance& instance)) {
 			size_t name_hash = Hash::dj2b(name.c_str());
-			if (method_id_lookup.contains(name_hash)) {
+			if (table.method_id_lookup.contains(name_hash)) {
 				return false;
 			}
 			
-			method_id_lookup.insert(std::make_pair(name_hash, methods.size()));
-			methods.push_back(method);
+			table.method_id_lookup.insert(std::make_pair(name_hash, table.methods.size()));
+			table.methods.push_back(method);
 			return true;
 		}
 	private:
-		phmap::flat_hash_map<size_t, uint32_t> method_id_lookup;
-		std::vector<instance::value(child_type::*)(std::vector<instance::value>& arguments, instance& instance)> methods;
+		//built exactly once, on first use, and never modified afterwards, so instances on different threads can share it
+		static const method_table& get_method_table() {
+			static const method_table table = [] {
+				method_table table;
+				if constexpr (requires { child_type::declare_methods(table); }) {
+					child_type::declare_methods(table);
+				}
+				return table;
+			}();
+			return table;
+		}
 	};
 
+	//getters are declared once per type by child_type's static declare_getters, like methods are
 	template<typename child_type>
 	class foreign_getter_object : public foreign_method_object<child_type> {
-	private:
-		std::unordered_map<size_t, instance::value(child_type::*)(instance& instance)> getters;
-
 	public:
 		instance::value load_property(size_t name_hash, instance& instance) override {
+			const getter_table& getters = get_getters();
 			auto it = getters.find(name_hash);
 			if (it == getters.end()) {
-				return dynamic_cast<foreign_method_object<child_type>*>(this)->load_property(name_hash, instance);
+				return foreign_method_object<child_type>::load_property(name_hash, instance);
 			}
-			return (dynamic_cast<child_type*>(this)->*(it->second))(instance);
+			return (static_cast<child_type*>(this)->*(it->second))(instance);
 		}
 
 	protected:
-		bool declare_getter(std::string name, instance::value(child_type::* getter)(instance& instance)) {
+		typedef std::unordered_map<size_t, instance::value(child_type::*)(instance& instance)> getter_table;
+
+		static bool declare_getter(getter_table& getters, std::string name, instance::value(child_type::* getter)(instance& instance)) {
 			size_t name_hash = Hash::dj2b(name.c_str());
 			if (getters.contains(name_hash)) {
 				return false;
@@ -63,13 +81,25 @@ namespace HulaScript {
 			getters.insert({ name_hash, getter });
 			return true;
 		}
+
+	private:
+		static const getter_table& get_getters() {
+			static const getter_table getters = [] {
+				getter_table getters;
+				if constexpr (requires { child_type::declare_getters(getters); }) {
+					child_type::declare_getters(getters);
+				}
+				return getters;
+			}();
+			return getters;
+		}
 	};
 
 	class foreign_iterator : public foreign_method_object<foreign_iterator> {
 	public:
-		foreign_iterator() {
-			declare_method("next", &foreign_iterator::ffi_next);
-			declare_method("hasNext", &foreign_iterator::ffi_has_next);
+		static void declare_methods(method_table& table) {
+			declare_method(table, "next", &foreign_iterator::ffi_next);
+			declare_method(table, "hasNext", &foreign_iterator::ffi_has_next);
 		}
 
 	protected:
@@ -89,33 +119,29 @@ namespace HulaScript {
 	//helps you access and manipulate a table
 	class ffi_table_helper {
 	public:
-		ffi_table_helper(size_t table_id, uint16_t flags, instance& owner_instance) : owner_instance(owner_instance), table_id(table_id), flags(flags) {
+		ffi_table_helper(size_t table_id, uint16_t flags, instance& owner_instance) : owner_instance(owner_instance), table_id(table_id), flags(flags), generation(owner_instance.get_table(table_id).generation) { }
 
-		}
-
-		ffi_table_helper(instance::value table_value, instance& owner_instance) : ffi_table_helper(table_value.data.id, table_value.flags, owner_instance) { 
-			table_value.expect_type(instance::value::vtype::TABLE, owner_instance);
-		}
+		ffi_table_helper(instance::value table_value, instance& owner_instance) : ffi_table_helper(expect_table_id(table_value, owner_instance), table_value.flags, owner_instance) { }
 
 		const bool is_array() const noexcept {
 			return flags & instance::value::vflags::TABLE_ARRAY_ITERATE;
 		}
 
 		const size_t size() const noexcept {
-			return owner_instance.tables.at(table_id).count;
+			return table_entry().count;
 		}
 
 		instance::value& at_index(size_t index) const {
-			instance::table& table_entry = owner_instance.tables.at(table_id);
-			if (index >= table_entry.count) {
+			instance::table& entry = table_entry();
+			if (index >= entry.count) {
 				throw std::out_of_range("Index is outside of the range of the table-array.");
 			}
 
-			return owner_instance.heap[table_entry.block.start + index];
+			return owner_instance.heap[entry.block.start + index];
 		}
 
 		void swap_index(size_t a, size_t b) {
-			instance::table& table_entry = owner_instance.tables.at(table_id);
+			instance::table& table_entry = this->table_entry();
 
 			if (a >= table_entry.count) {
 				throw std::out_of_range("Index a is outside of the range of the table-array.");
@@ -139,12 +165,29 @@ namespace HulaScript {
 
 		bool remove(instance::value value);
 
+		instance::value get_table() const noexcept {
+			return instance::value(instance::value::vtype::TABLE, flags, 0, table_id);
+		}
+
 		void temp_gc_protect() {
-			owner_instance.temp_gc_protect(instance::value(instance::value::vtype::TABLE, flags, 0, table_id));
+			owner_instance.temp_gc_protect(get_table());
 		}
 	private:
 		size_t table_id;
 		instance& owner_instance;
 		uint16_t flags;
+		uint32_t generation; //kept in release builds too, so the layout doesn't depend on NDEBUG
+
+		//checks the type before the table is looked up, since the delegated constructor reads it's generation
+		static size_t expect_table_id(instance::value& table_value, instance& owner_instance) {
+			table_value.expect_type(instance::value::vtype::TABLE, owner_instance);
+			return table_value.data.id;
+		}
+
+		instance::table& table_entry() const noexcept {
+			instance::table& entry = owner_instance.get_table(table_id);
+			assert(entry.generation == generation); //table was collected while the helper was still in use
+			return entry;
+		}
 	};
 }
\ No newline at end of file
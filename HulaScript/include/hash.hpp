@@ -7,6 +7,16 @@ namespace HulaScript::Hash {
             5381;
     }
 
+    //same result as dj2b, for strings whose length is already known
+    static size_t dj2b(char const* input, size_t length) noexcept {
+        size_t hash = 5381;
+        while (length > 0) {
+            length--;
+            hash = static_cast<size_t>(input[length]) + 33 * hash;
+        }
+        return hash;
+    }
+
     //copied straight from boost
     static size_t constexpr combine(size_t lhs, size_t rhs) {
         lhs ^= rhs + 0x9e3779b9 + (lhs << 6) + (lhs >> 2);
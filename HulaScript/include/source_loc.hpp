@@ -4,6 +4,8 @@
 #include <string>
 
 namespace HulaScript {
+	class instance;
+
 	class source_loc {
 	public:
 		source_loc(size_t row, size_t col) : source_loc(row, col, std::nullopt, std::nullopt) { }
@@ -16,5 +18,7 @@ namespace HulaScript {
 		size_t row, col;
 		std::optional<std::string> function_name;
 		std::optional<std::string> file_name;
+
+		friend class instance;
 	};
 }
\ No newline at end of file
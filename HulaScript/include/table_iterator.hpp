@@ -24,6 +24,10 @@ namespace HulaScript {
 			position++;
 			return to_ret;
 		}
+
+		void trace(std::vector<instance::value>& to_trace) override {
+			to_trace.push_back(helper.get_table());
+		}
 	};
 
 	class handled_error : public foreign_method_object<handled_error> {
@@ -46,11 +50,13 @@ namespace HulaScript {
 			return instance.rational_integer(error_.code());
 		}
 	public:
-		handled_error(runtime_error error_) : error_(error_) {
-			declare_method("stackTrace", &handled_error::stack_trace);
-			declare_method("msg", &handled_error::msg);
-			declare_method("what", &handled_error::what);
-			declare_method("code", &handled_error::code);
+		handled_error(runtime_error error_) : error_(error_) { }
+
+		static void declare_methods(method_table& table) {
+			declare_method(table, "stackTrace", &handled_error::stack_trace);
+			declare_method(table, "msg", &handled_error::msg);
+			declare_method(table, "what", &handled_error::what);
+			declare_method(table, "code", &handled_error::code);
 		}
 
 		const runtime_error error() const noexcept {
@@ -68,6 +74,7 @@ namespace HulaScript {
 	public:
 		foreign_imported_library(dynalo::native::handle library_handle) : library_handle(library_handle) {
 			assert(library_handle != dynalo::native::invalid_handle());
+			gc_tag = gc_kind::GC_KIND_IMPORTED_LIBRARY;
 
 			auto manifest_func = dynalo::get_function<const char** (instance::foreign_object*)>(library_handle, "manifest");
 			auto manifest = manifest_func(this);
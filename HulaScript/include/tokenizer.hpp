@@ -2,6 +2,7 @@
 
 #include <variant>
 #include <string>
+#include <string_view>
 #include <optional>
 #include <vector>
 #include "error.hpp"
@@ -79,17 +80,24 @@ namespace HulaScript {
 	class token {
 	public:
 		token(token_type type) : _type(type), payload() { }
-		token(token_type type, std::string str) : _type(type), payload(str) { }
+		token(token_type type, std::string_view text) : _type(type), payload(text) { } //text is a view into the tokenizer's source
+		token(token_type type, std::string decoded) : _type(type), payload(std::move(decoded)) { } //a string literal whose escapes were decoded
 
-		token(std::string identifier) : _type(token_type::IDENTIFIER), payload(identifier) { }
 		token(double number) : _type(token_type::DOUBLE), payload(number) { }
 
 		const token_type type() const noexcept {
 			return _type;
 		}
 
+		std::string_view view() const noexcept {
+			if (std::holds_alternative<std::string>(payload)) {
+				return std::get<std::string>(payload);
+			}
+			return std::get<std::string_view>(payload);
+		}
+
 		const std::string str() const {
-			return std::get<std::string>(payload);
+			return std::string(view());
 		}
 
 		const double number() const {
@@ -101,12 +109,13 @@ namespace HulaScript {
 		}
 	private:
 		token_type _type;
-		std::variant<std::monostate, double, std::string> payload;
+		std::variant<std::monostate, double, std::string_view, std::string> payload;
 	};
 
 	class tokenizer {
 	public:
-		tokenizer(std::string source, std::optional<std::string> file_name) : source(source), file_name(file_name), pos(0), current_row(1), current_col(0), last_tok_row(0), last_tok_col(0), last_char(0), last_token(token_type::END_OF_SOURCE) { 
+		//source isn't copied; it must outlive the tokenizer
+		tokenizer(std::string_view source, std::optional<std::string> file_name) : source(source), file_name(file_name), pos(0), current_row(1), current_col(0), last_tok_row(0), last_tok_col(0), char_pos(0), last_char(0), last_token(token_type::END_OF_SOURCE) { 
 			scan_char();
 			scan_token();
 		}
@@ -137,7 +146,7 @@ namespace HulaScript {
 		void unexpected_token() const;
 		void expect_tokens(std::vector<token_type> expected_type) const;
 
-		const token get_last_token() const noexcept {
+		const token& get_last_token() const noexcept {
 			return last_token;
 		}
 
@@ -158,12 +167,15 @@ namespace HulaScript {
 		void exit_function() {
 			functions.pop_back();
 		}
+
+		//scans to the end token closing the block the current token is in, without compiling anything
+		void skip_block();
 	private:
 		std::optional<std::string> file_name;
 		std::vector<std::string> functions;
-		std::string source;
+		std::string_view source;
 		size_t pos, last_tok_row, last_tok_col, current_row, current_col;
-
+		size_t char_pos; //where last_char is in source
 		char last_char;
 		token last_token;
 
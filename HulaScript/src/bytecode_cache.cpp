@@ -0,0 +1,515 @@
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <atomic>
+#include <random>
+#include <sstream>
+#include "HulaScript.hpp"
+
+using namespace HulaScript;
+
+//layout of a .hsc file, all integers in native byte order:
+//	header: magic, version, opcode count, source hash, module hash
+//	constants: count, then each constant as it's type followed by it's characters or it's raw payload
+//	functions: count, then each function's name, parameter count and code
+//	top-level code
+//	checksum of everything before it
+//code is it's instructions followed by it's source locations; constant and function ids in instructions are replaced by indices into the file's tables
+
+namespace {
+	static constexpr char CACHE_MAGIC[4] = { 'H', 'S', 'C', '\0' };
+
+	struct malformed_cache { };
+
+	class cache_writer {
+	public:
+		template<typename T>
+		void write(T val) {
+			buffer.append(reinterpret_cast<const char*>(&val), sizeof(T));
+		}
+
+		void write_str(std::string_view str) {
+			write(static_cast<uint32_t>(str.size()));
+			buffer.append(str);
+		}
+
+		void write_opt_str(const std::optional<std::string>& str) {
+			write(static_cast<uint8_t>(str.has_value()));
+			if (str.has_value()) {
+				write_str(str.value());
+			}
+		}
+
+		std::string buffer;
+	};
+
+	class cache_reader {
+	public:
+		cache_reader(std::string_view buffer) : buffer(buffer), pos(0) { }
+
+		template<typename T>
+		T read() {
+			if (buffer.size() - pos < sizeof(T)) {
+				throw malformed_cache();
+			}
+			T val;
+			std::memcpy(&val, buffer.data() + pos, sizeof(T));
+			pos += sizeof(T);
+			return val;
+		}
+
+		std::string read_str() {
+			uint32_t length = read<uint32_t>();
+			if (buffer.size() - pos < length) {
+				throw malformed_cache();
+			}
+			std::string str(buffer.substr(pos, length));
+			pos += length;
+			return str;
+		}
+
+		std::optional<std::string> read_opt_str() {
+			if (read<uint8_t>()) {
+				return read_str();
+			}
+			return std::nullopt;
+		}
+
+		//a count is never larger than the bytes left to hold it's elements
+		uint32_t read_count(size_t min_element_size) {
+			uint32_t count = read<uint32_t>();
+			if (count > (buffer.size() - pos) / min_element_size) {
+				throw malformed_cache();
+			}
+			return count;
+		}
+
+		bool at_end() const noexcept {
+			return pos == buffer.size();
+		}
+	private:
+		std::string_view buffer;
+		size_t pos;
+	};
+}
+
+std::optional<std::string> instance::serialize_module(size_t source_hash, size_t module_hash, std::pair<size_t, size_t> top_level) {
+	auto read_id = [this](size_t addr) -> uint32_t {
+		uint32_t id = instructions[addr].operand;
+		id = (id << 8) + static_cast<uint8_t>(instructions[addr + 1].operation);
+		return (id << 8) + instructions[addr + 1].operand;
+	};
+	auto is_function_op = [](opcode op) -> bool {
+		return op == opcode::CALL_LABEL || (op >= opcode::CAPTURE_FUNCPTR && op <= opcode::CAPTURE_VARIADIC_CLOSURE);
+	};
+
+	//number every function reachable from the top-level code; the top-level code is the first span
+	std::vector<std::pair<size_t, size_t>> spans = { top_level };
+	std::vector<uint32_t> function_order;
+	phmap::flat_hash_map<uint32_t, uint32_t> function_indices;
+	std::vector<uint32_t> constant_order;
+	phmap::flat_hash_map<uint32_t, uint32_t> constant_indices;
+
+	auto number_constant = [&](uint32_t id) {
+		if (constant_indices.insert({ id, static_cast<uint32_t>(constant_order.size()) }).second) {
+			constant_order.push_back(id);
+		}
+	};
+
+	//constants loaded with LOAD_CONSTANT_FAST are numbered first, so their indices still fit in one operand
+	for (size_t i = 0; i < spans.size(); i++) {
+		for (size_t addr = spans[i].first; addr < spans[i].first + spans[i].second; addr++) {
+			opcode op = instructions[addr].operation;
+			if (op == opcode::LOAD_CONSTANT_FAST) {
+				number_constant(instructions[addr].operand);
+			}
+			else if (op == opcode::LOAD_CONSTANT) {
+				addr++;
+			}
+			else if (is_function_op(op)) {
+				uint32_t id = read_id(addr);
+				if (function_indices.insert({ id, static_cast<uint32_t>(function_order.size()) }).second) {
+					function_order.push_back(id);
+					const function_entry& function = functions.at(id);
+					if (function.length == 0) { //a lazy function has no code to cache until it's called
+						return std::nullopt;
+					}
+					spans.push_back(std::make_pair(function.start_address, function.length));
+				}
+				addr++;
+			}
+		}
+	}
+	for (auto span : spans) {
+		for (size_t addr = span.first; addr < span.first + span.second; addr++) {
+			opcode op = instructions[addr].operation;
+			if (op == opcode::LOAD_CONSTANT) {
+				number_constant(read_id(addr));
+				addr++;
+			}
+			else if (is_function_op(op)) {
+				addr++;
+			}
+		}
+	}
+
+	cache_writer writer;
+	writer.buffer.append(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	writer.write(MODULE_CACHE_VERSION);
+	writer.write(static_cast<uint8_t>(opcode::COMPARE_ERROR_CODE));
+	writer.write(static_cast<uint64_t>(source_hash));
+	writer.write(static_cast<uint64_t>(module_hash));
+
+	writer.write(static_cast<uint32_t>(constant_order.size()));
+	for (uint32_t id : constant_order) {
+		const value& constant = constants[id];
+		switch (constant.type) {
+		case value::vtype::STRING:
+			writer.write(static_cast<uint8_t>(constant.type));
+			writer.write_str(constant.chars_view());
+			break;
+		case value::vtype::NIL:
+		case value::vtype::DOUBLE:
+		case value::vtype::RATIONAL:
+		case value::vtype::BOOLEAN:
+		case value::vtype::INTERNAL_STRHASH:
+			writer.write(static_cast<uint8_t>(constant.type));
+			writer.write(constant.flags);
+			writer.write(constant.function_id);
+			writer.write(static_cast<uint64_t>(constant.data.id));
+			break;
+		default: //constants that point into the instance, like the result of a custom numerical parser, can't be cached
+			return std::nullopt;
+		}
+	}
+
+	auto write_code = [&](size_t start, size_t length) {
+		writer.write(static_cast<uint32_t>(length));
+		for (size_t addr = start; addr < start + length; addr++) {
+			instruction ins = instructions[addr];
+			if (ins.operation == opcode::LOAD_CONSTANT_FAST) {
+				ins.operand = static_cast<operand>(constant_indices.at(ins.operand));
+			}
+			else if (ins.operation == opcode::LOAD_CONSTANT || is_function_op(ins.operation)) {
+				uint32_t index = ins.operation == opcode::LOAD_CONSTANT ? constant_indices.at(read_id(addr)) : function_indices.at(read_id(addr));
+				writer.write(static_cast<uint8_t>(ins.operation));
+				writer.write(static_cast<uint8_t>(index >> 16));
+				writer.write(static_cast<uint8_t>((index >> 8) & 0xFF));
+				writer.write(static_cast<uint8_t>(index & 0xFF));
+				addr++;
+				continue;
+			}
+			writer.write(static_cast<uint8_t>(ins.operation));
+			writer.write(ins.operand);
+		}
+
+		auto begin = ip_src_map.lower_bound(start);
+		auto end = ip_src_map.lower_bound(start + length);
+		writer.write(static_cast<uint32_t>(std::distance(begin, end)));
+		for (auto it = begin; it != end; it++) {
+			writer.write(static_cast<uint32_t>(it->first - start));
+			writer.write(static_cast<uint64_t>(it->second->row));
+			writer.write(static_cast<uint64_t>(it->second->col));
+			writer.write_opt_str(it->second->function_name);
+			writer.write_opt_str(it->second->file_name);
+		}
+	};
+
+	writer.write(static_cast<uint32_t>(function_order.size()));
+	for (uint32_t id : function_order) {
+		const function_entry& function = functions.at(id);
+		writer.write_str(function.name);
+		writer.write(function.parameter_count);
+		write_code(function.start_address, function.length);
+	}
+	write_code(top_level.first, top_level.second);
+	writer.write(static_cast<uint64_t>(Hash::dj2b(writer.buffer.data(), writer.buffer.size())));
+	return writer.buffer;
+}
+
+bool instance::save_module_cache(const std::string& path, const std::string& bytecode) {
+	//write to a temporary file first, so a reader never sees a partially written cache
+	//each writer gets it's own temporary file, since other threads or processes may be saving the same module at once
+	static std::atomic<uint64_t> temp_file_count = 0;
+	std::stringstream temp_ss;
+	temp_ss << path << '.' << std::hex << std::random_device()() << '.' << temp_file_count++ << ".tmp";
+	std::string temp_path = temp_ss.str();
+	{
+		std::ofstream outfile(temp_path, std::ios::binary | std::ios::trunc);
+		if (outfile.fail()) {
+			return false;
+		}
+		outfile.write(bytecode.data(), bytecode.size());
+		outfile.close();
+		if (outfile.fail()) {
+			std::error_code error;
+			std::filesystem::remove(temp_path, error);
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temp_path, path, error);
+	if (error) {
+		std::filesystem::remove(temp_path, error);
+		return false;
+	}
+	return true;
+}
+
+bool instance::link_module(std::string_view bytecode, size_t source_hash, size_t module_hash) {
+	//a flipped byte could still pass the checks below, so the contents must match their checksum
+	if (bytecode.size() < sizeof(uint64_t)) {
+		return false;
+	}
+	uint64_t checksum;
+	std::memcpy(&checksum, bytecode.data() + bytecode.size() - sizeof(uint64_t), sizeof(uint64_t));
+	std::string_view buffer = bytecode.substr(0, bytecode.size() - sizeof(uint64_t));
+	if (checksum != static_cast<uint64_t>(Hash::dj2b(buffer.data(), buffer.size()))) {
+		return false;
+	}
+
+	struct cached_constant {
+		value::vtype type;
+		uint16_t flags;
+		uint32_t function_id;
+		uint64_t data;
+		std::string chars;
+		bool loaded_fast;
+	};
+	struct cached_code {
+		std::vector<instruction> instructions;
+		std::vector<std::pair<size_t, source_loc>> src_locs;
+	};
+	struct cached_function {
+		std::string name;
+		operand parameter_count;
+		cached_code code;
+	};
+
+	std::vector<cached_constant> cached_constants;
+	std::vector<cached_function> cached_functions;
+	cached_code top_level;
+
+	//verification pass: everything is parsed and checked before anything is linked into the instance
+	try {
+		cache_reader reader(buffer);
+		char magic[sizeof(CACHE_MAGIC)];
+		for (size_t i = 0; i < sizeof(CACHE_MAGIC); i++) {
+			magic[i] = reader.read<char>();
+		}
+		if (std::memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+			reader.read<uint32_t>() != MODULE_CACHE_VERSION ||
+			reader.read<uint8_t>() != static_cast<uint8_t>(opcode::COMPARE_ERROR_CODE) ||
+			reader.read<uint64_t>() != static_cast<uint64_t>(source_hash) ||
+			reader.read<uint64_t>() != static_cast<uint64_t>(module_hash)) {
+			return false;
+		}
+
+		uint32_t constant_count = reader.read_count(1);
+		cached_constants.reserve(constant_count);
+		for (uint32_t i = 0; i < constant_count; i++) {
+			cached_constant constant = { .type = static_cast<value::vtype>(reader.read<uint8_t>()), .flags = 0, .function_id = 0, .data = 0, .loaded_fast = false };
+			switch (constant.type) {
+			case value::vtype::STRING:
+				constant.chars = reader.read_str();
+				break;
+			case value::vtype::NIL:
+			case value::vtype::DOUBLE:
+			case value::vtype::RATIONAL:
+			case value::vtype::BOOLEAN:
+			case value::vtype::INTERNAL_STRHASH:
+				constant.flags = reader.read<uint16_t>();
+				constant.function_id = reader.read<uint32_t>();
+				constant.data = reader.read<uint64_t>();
+				if (constant.flags & (value::vflags::INVALID_CONSTANT | value::vflags::STRING_IS_INLINE)) {
+					throw malformed_cache();
+				}
+				break;
+			default:
+				throw malformed_cache();
+			}
+			cached_constants.push_back(constant);
+		}
+
+		uint32_t function_count = reader.read_count(1);
+		auto read_code = [&](cached_code& code, bool is_top_level) {
+			uint32_t length = reader.read_count(2);
+			if (length == 0) {
+				throw malformed_cache();
+			}
+			code.instructions.reserve(length);
+			for (uint32_t i = 0; i < length; i++) {
+				opcode op = static_cast<opcode>(reader.read<uint8_t>());
+				operand operand = reader.read<uint8_t>();
+				code.instructions.push_back({ .operation = op, .operand = operand });
+			}
+
+			//check every opcode is valid, every operand refers to something within the file, and that control never leaves the code
+			//the second word of a two-word instruction holds part of an index rather than an opcode, so it's skipped
+			for (size_t addr = 0; addr < length; addr++) {
+				instruction& ins = code.instructions[addr];
+				if (ins.operation > opcode::COMPARE_ERROR_CODE) {
+					throw malformed_cache();
+				}
+				switch (ins.operation) {
+				case opcode::LOAD_CONSTANT_FAST:
+					if (ins.operand >= cached_constants.size()) {
+						throw malformed_cache();
+					}
+					cached_constants[ins.operand].loaded_fast = true;
+					break;
+				case opcode::LOAD_CONSTANT:
+				case opcode::CALL_LABEL:
+				case opcode::CAPTURE_FUNCPTR:
+				case opcode::CAPTURE_CLOSURE:
+				case opcode::CAPTURE_VARIADIC_FUNCPTR:
+				case opcode::CAPTURE_VARIADIC_CLOSURE: {
+					if (addr + 1 >= length) {
+						throw malformed_cache();
+					}
+					uint32_t index = ins.operand;
+					index = (index << 8) + static_cast<uint8_t>(code.instructions[addr + 1].operation);
+					index = (index << 8) + code.instructions[addr + 1].operand;
+					if (index >= (ins.operation == opcode::LOAD_CONSTANT ? cached_constants.size() : function_count)) {
+						throw malformed_cache();
+					}
+					addr++;
+					break;
+				}
+				case opcode::JUMP_AHEAD:
+				case opcode::IF_FALSE_JUMP_AHEAD:
+				case opcode::IFNT_NIL_JUMP_AHEAD:
+				case opcode::TRY_HANDLE_ERROR:
+					if (addr + ins.operand >= length) {
+						throw malformed_cache();
+					}
+					break;
+				case opcode::JUMP_BACK:
+				case opcode::IF_FALSE_JUMP_BACK:
+					if (ins.operand > addr) {
+						throw malformed_cache();
+					}
+					break;
+				default:
+					break;
+				}
+			}
+
+			opcode last_op = code.instructions.back().operation;
+			if (is_top_level ? last_op != opcode::STOP : (last_op != opcode::RETURN && last_op != opcode::JUMP_BACK)) {
+				throw malformed_cache();
+			}
+
+			uint32_t src_count = reader.read_count(22);
+			code.src_locs.reserve(src_count);
+			for (uint32_t i = 0; i < src_count; i++) {
+				uint32_t offset = reader.read<uint32_t>();
+				if (offset >= length) {
+					throw malformed_cache();
+				}
+				size_t row = reader.read<uint64_t>();
+				size_t col = reader.read<uint64_t>();
+				auto function_name = reader.read_opt_str();
+				auto file_name = reader.read_opt_str();
+				code.src_locs.push_back(std::make_pair(offset, source_loc(row, col, function_name, file_name)));
+			}
+		};
+
+		cached_functions.reserve(function_count);
+		for (uint32_t i = 0; i < function_count; i++) {
+			cached_function function;
+			function.name = reader.read_str();
+			function.parameter_count = reader.read<operand>();
+			read_code(function.code, false);
+			cached_functions.push_back(std::move(function));
+		}
+		read_code(top_level, true);
+
+		if (!reader.at_end()) {
+			throw malformed_cache();
+		}
+	}
+	catch (const malformed_cache&) {
+		return false;
+	}
+
+	//link constants; a constant loaded with LOAD_CONSTANT_FAST must land on an id that fits in one operand
+	std::vector<uint32_t> constant_ids;
+	constant_ids.reserve(cached_constants.size());
+	for (auto& constant : cached_constants) {
+		value val = constant.type == value::vtype::STRING ? make_string(constant.chars) : value(constant.type, constant.flags, constant.function_id, constant.data);
+		uint32_t id = add_constant(val);
+		if (constant.loaded_fast && id > UINT8_MAX) {
+			return false; //unused constants that were added are freed by the next collection
+		}
+		constant_ids.push_back(id);
+	}
+
+	std::vector<uint32_t> function_ids;
+	function_ids.reserve(cached_functions.size());
+	for (size_t i = 0; i < cached_functions.size(); i++) {
+		if (available_function_ids.empty()) {
+			function_ids.push_back(next_function_id++);
+		}
+		else {
+			function_ids.push_back(available_function_ids.back());
+			available_function_ids.pop_back();
+		}
+	}
+
+	//copies code into instructions, replacing the file's indices with the ids linked above
+	auto link_code = [&](const cached_code& code, std::vector<uint32_t>& refed_constants, std::vector<uint32_t>& refed_functions) -> size_t {
+		size_t start = allocate_code(code.instructions.size());
+		std::copy(code.instructions.begin(), code.instructions.end(), instructions.begin() + start);
+
+		for (size_t addr = start; addr < start + code.instructions.size(); addr++) {
+			instruction& ins = instructions[addr];
+			if (ins.operation == opcode::LOAD_CONSTANT_FAST) {
+				ins.operand = static_cast<operand>(constant_ids[ins.operand]);
+				refed_constants.push_back(ins.operand);
+			}
+			else if (ins.operation == opcode::LOAD_CONSTANT || ins.operation == opcode::CALL_LABEL || (ins.operation >= opcode::CAPTURE_FUNCPTR && ins.operation <= opcode::CAPTURE_VARIADIC_CLOSURE)) {
+				uint32_t index = ins.operand;
+				index = (index << 8) + static_cast<uint8_t>(instructions[addr + 1].operation);
+				index = (index << 8) + instructions[addr + 1].operand;
+
+				uint32_t id;
+				if (ins.operation == opcode::LOAD_CONSTANT) {
+					id = constant_ids[index];
+					refed_constants.push_back(id);
+				}
+				else {
+					id = function_ids[index];
+					refed_functions.push_back(id);
+				}
+				ins.operand = static_cast<operand>(id >> 16);
+				instructions[addr + 1] = { .operation = static_cast<opcode>((id >> 8) & 0xFF), .operand = static_cast<operand>(id & 0xFF) };
+				addr++;
+			}
+		}
+
+		for (auto& src_loc : code.src_locs) {
+			ip_src_map.insert(std::make_pair(start + src_loc.first, src_loc.second));
+		}
+		return start;
+	};
+
+	for (size_t i = 0; i < cached_functions.size(); i++) {
+		cached_function& cached = cached_functions[i];
+		std::vector<uint32_t> refed_constants;
+		std::vector<uint32_t> refed_functions;
+		size_t start = link_code(cached.code, refed_constants, refed_functions);
+
+		function_entry function(cached.name, start, cached.code.instructions.size(), cached.parameter_count);
+		function.referenced_constants = std::move(refed_constants);
+		function.referenced_functions = std::move(refed_functions);
+		functions.insert({ function_ids[i], function });
+		count_function_allocation(cached.code.instructions.size(), cached.code.src_locs.size());
+	}
+
+	//the top-level code keeps what it references alive until it finishes, like freshly compiled code
+	ip = link_code(top_level, repl_used_constants, repl_used_functions);
+	top_level_code.push_back(std::make_pair(ip, top_level.instructions.size()));
+	return true;
+}
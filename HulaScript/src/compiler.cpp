@@ -5,6 +5,21 @@
 
 using namespace HulaScript;
 
+//array-tables answer these properties with a value bound to the table itself, so reading one lets the table escape
+static bool is_bound_table_method(size_t name_hash) {
+	switch (name_hash)
+	{
+	case Hash::dj2b("iterator"):
+	case Hash::dj2b("filter"):
+	case Hash::dj2b("append"):
+	case Hash::dj2b("appendRange"):
+	case Hash::dj2b("remove"):
+		return true;
+	default:
+		return false;
+	}
+}
+
 std::pair<instance::compilation_context::variable, bool> instance::compilation_context::alloc_local(std::string name, bool must_declare) {
 	if (lexical_scopes.back().next_local_id == UINT8_MAX) {
 		panic("Compiler Error: Cannot allocate more than 256 locals.");
@@ -32,6 +47,7 @@ std::pair<instance::compilation_context::variable, bool> instance::compilation_c
 	lexical_scopes.back().next_local_id++;
 	lexical_scopes.back().declared_locals.push_back(hash);
 	active_variables.insert({ hash, v });
+	variables_snapshot.reset();
 	return std::make_pair(v, true);
 }
 
@@ -52,6 +68,7 @@ bool instance::compilation_context::alloc_and_store(std::string name, bool must_
 			panic(ss.str());
 		}
 
+		mark_escaped(res.first.name_hash);
 		emit({ .operation = opcode::STORE_LOCAL, .operand = res.first.offset });
 		return false;
 	}
@@ -78,6 +95,7 @@ instance::operand instance::compilation_context::alloc_global(std::string name)
 		.func_id = 0
 	} });
 	declared_globals.push_back(hash);
+	variables_snapshot.reset();
 	return var_offset;
 }
 
@@ -141,6 +159,7 @@ void instance::emit_load_variable(std::string name, compilation_context& context
 			context.emit({ .operation = opcode::LOAD_TABLE });
 		}
 		else {
+			context.mark_escaped(hash);
 			context.emit({ .operation = opcode::LOAD_LOCAL, .operand = it->second.offset });
 		}
 	}
@@ -172,6 +191,7 @@ void instance::compile_args_and_call(compilation_context& context) {
 void instance::compile_value(compilation_context& context, bool expects_statement, bool expects_value) {
 	auto token = context.tokenizer.get_last_token();
 	context.set_src_loc(context.tokenizer.last_tok_begin());
+	std::optional<size_t> scoped_table_access = std::nullopt;
 
 	switch (token.type())
 	{
@@ -244,9 +264,17 @@ void instance::compile_value(compilation_context& context, bool expects_statemen
 
 		if (context.tokenizer.match_token(token_type::SET)) {
 			context.tokenizer.scan_token();
+			bool starts_with_table = context.tokenizer.match_token(token_type::OPEN_BRACKET) || context.tokenizer.match_token(token_type::OPEN_BRACE);
 			compile_expression(context);
+			bool is_table_literal = starts_with_table && context.table_literal_end == std::make_pair(context.lexical_scopes.size(), context.current_ip());
 			bool declared = context.alloc_and_store(id);
 
+			if (declared && is_table_literal && context.lexical_scopes.size() > 1) {
+				size_t hash = Hash::dj2b(id.c_str());
+				context.scoped_tables.insert_or_assign(hash, false);
+				context.lexical_scopes.back().scoped_tables.push_back(hash);
+			}
+
 			if (declared && expects_value) {
 				context.panic("Syntax Error: Cannot declare variable outside a statement.");
 			}
@@ -258,7 +286,15 @@ void instance::compile_value(compilation_context& context, bool expects_statemen
 			return;
 		}
 		else {
-			emit_load_variable(id, context);
+			//storing into a scoped table doesn't let it escape; reads that may produce a method bound to the table do, as does calling the element
+			size_t hash = Hash::dj2b(id.c_str());
+			if (context.is_scoped_table(hash) && (context.tokenizer.match_token(token_type::PERIOD) || context.tokenizer.match_token(token_type::OPEN_BRACKET))) {
+				scoped_table_access = hash;
+				context.emit({ .operation = opcode::LOAD_LOCAL, .operand = context.active_variables.at(hash).offset });
+			}
+			else {
+				emit_load_variable(id, context);
+			}
 			break;
 		}
 	}
@@ -297,6 +333,7 @@ void instance::compile_value(compilation_context& context, bool expects_statemen
 			context.panic(ss.str());
 		}
 		context.set_operand(addr, static_cast<operand>(count));
+		context.table_literal_end = std::make_pair(context.lexical_scopes.size(), context.current_ip());
 
 		break;
 	}
@@ -315,7 +352,8 @@ void instance::compile_value(compilation_context& context, bool expects_statemen
 			if (context.tokenizer.match_token(token_type::PERIOD)) {
 				context.tokenizer.scan_token();
 				context.tokenizer.expect_token(token_type::IDENTIFIER);
-				emit_load_property(Hash::dj2b(context.tokenizer.get_last_token().str().c_str()), context);
+				std::string_view property_name = context.tokenizer.get_last_token().view();
+				emit_load_property(Hash::dj2b(property_name.data(), property_name.size()), context);
 				context.tokenizer.scan_token();
 				context.tokenizer.expect_token(token_type::SET);
 				context.tokenizer.scan_token();
@@ -348,6 +386,7 @@ void instance::compile_value(compilation_context& context, bool expects_statemen
 			context.panic(ss.str());
 		}
 		context.set_operand(addr, static_cast<operand>(count));
+		context.table_literal_end = std::make_pair(context.lexical_scopes.size(), context.current_ip());
 
 		break;
 	}
@@ -405,7 +444,7 @@ void instance::compile_value(compilation_context& context, bool expects_statemen
 		else if (context.tokenizer.match_token(token_type::NUMBER_CUSTOM)) {
 			std::string to_parse;
 			to_parse.push_back('-');
-			to_parse.append(context.tokenizer.get_last_token().str());
+			to_parse.append(context.tokenizer.get_last_token().view());
 			context.emit_load_constant(add_constant(numerical_parser(to_parse, *this)), repl_used_constants);
 			context.tokenizer.scan_token();
 			break;
@@ -421,8 +460,12 @@ void instance::compile_value(compilation_context& context, bool expects_statemen
 	}
 
 	bool is_statement = false;
-	for (;;) {
+	for (size_t postfix_count = 0;; postfix_count++) {
 		token = context.tokenizer.get_last_token();
+		if (scoped_table_access.has_value() && postfix_count == 1 && (token.type() == token_type::OPEN_PAREN || token.type() == token_type::VARIADIC)) {
+			context.mark_escaped(scoped_table_access.value());
+		}
+
 		switch (token.type())
 		{
 		case token_type::PERIOD: {
@@ -430,7 +473,8 @@ void instance::compile_value(compilation_context& context, bool expects_statemen
 			context.tokenizer.expect_token(token_type::IDENTIFIER);
 
 			std::string property_name = context.tokenizer.get_last_token().str();
-			emit_load_property(Hash::dj2b(property_name.c_str()), context);
+			size_t property_hash = Hash::dj2b(property_name.c_str());
+			emit_load_property(property_hash, context);
 			context.tokenizer.scan_token();
 
 			if (context.tokenizer.match_token(token_type::SET)) {
@@ -444,6 +488,9 @@ void instance::compile_value(compilation_context& context, bool expects_statemen
 				return;
 			}
 			else {
+				if (scoped_table_access.has_value() && postfix_count == 0 && is_bound_table_method(property_hash)) {
+					context.mark_escaped(scoped_table_access.value());
+				}
 				context.emit({ .operation = opcode::LOAD_TABLE });
 				is_statement = false;
 				break;
@@ -451,7 +498,13 @@ void instance::compile_value(compilation_context& context, bool expects_statemen
 		}
 		case token_type::OPEN_BRACKET: {
 			context.tokenizer.scan_token();
+			bool number_key = context.tokenizer.match_token(token_type::DOUBLE);
+			size_t key_ip = context.current_ip();
 			compile_expression(context);
+			if (number_key) {
+				opcode key_op = context.code_buffers.back().instructions[key_ip].operation;
+				number_key = (key_op == opcode::LOAD_CONSTANT_FAST && context.current_ip() - key_ip == 1) || (key_op == opcode::LOAD_CONSTANT && context.current_ip() - key_ip == 2);
+			}
 			context.tokenizer.expect_token(token_type::CLOSE_BRACKET);
 			context.tokenizer.scan_token();
 
@@ -467,6 +520,10 @@ void instance::compile_value(compilation_context& context, bool expects_statemen
 				return;
 			}
 			else {
+				//only a lone number literal is provably an element read; any other key may name a bound method
+				if (scoped_table_access.has_value() && postfix_count == 0 && !number_key) {
+					context.mark_escaped(scoped_table_access.value());
+				}
 				context.emit({ .operation = opcode::LOAD_TABLE });
 
 				is_statement = false;
@@ -565,10 +622,10 @@ void instance::compile_statement(compilation_context& context, bool expects_stat
 		context.set_operand(context.emit({ .operation = opcode::JUMP_BACK }), context.current_ip() - continue_dest_ip);
 
 		for (size_t continue_req_ip : lexical_scope.continue_requests) {
-			context.set_instruction(continue_req_ip + lexical_scope.final_ins_offset, opcode::JUMP_BACK, continue_dest_ip - (continue_req_ip + lexical_scope.final_ins_offset));
+			context.set_instruction(continue_req_ip, opcode::JUMP_BACK, continue_dest_ip - continue_req_ip);
 		}
 		for (size_t break_req_ip : lexical_scope.break_requests) {
-			context.set_operand(break_req_ip + lexical_scope.final_ins_offset, context.current_ip() - (break_req_ip + lexical_scope.final_ins_offset));
+			context.set_operand(break_req_ip, context.current_ip() - break_req_ip);
 		}
 		context.set_operand(cond_ip, context.current_ip() - cond_ip);
 
@@ -585,12 +642,12 @@ void instance::compile_statement(compilation_context& context, bool expects_stat
 		}
 
 		for (size_t continue_req_ip : lexical_scope.continue_requests) {
-			context.set_instruction(continue_req_ip + lexical_scope.final_ins_offset, opcode::JUMP_AHEAD, context.current_ip() - (continue_req_ip + lexical_scope.final_ins_offset));
+			context.set_instruction(continue_req_ip, opcode::JUMP_AHEAD, context.current_ip() - continue_req_ip);
 		}
 		compile_expression(context); 
 		context.emit({ .operation = opcode::IF_FALSE_JUMP_BACK, .operand = static_cast<operand>(context.current_ip() - repeat_dest_ip) });
 		for (size_t break_req_ip : lexical_scope.break_requests) {
-			context.set_operand(break_req_ip + lexical_scope.final_ins_offset, context.current_ip() - (break_req_ip + lexical_scope.final_ins_offset));
+			context.set_operand(break_req_ip, context.current_ip() - break_req_ip);
 		}
 
 		break;
@@ -652,6 +709,7 @@ void instance::compile_statement(compilation_context& context, bool expects_stat
 		else {
 			compile_expression(context);
 		}
+		context.emit_release_scoped_tables();
 		context.emit({ .operation = opcode::RETURN });
 
 		context.lexical_scopes.back().all_code_paths_return = true;
@@ -717,12 +775,14 @@ instance::compilation_context::lexical_scope instance::compile_block(compilation
 }
 
 void instance::make_lexical_scope(compilation_context& context, bool is_loop) {
-	auto prev_scope = context.lexical_scopes.back();
+	size_t next_local_id = context.lexical_scopes.back().next_local_id;
 
-	context.lexical_scopes.push_back({ .next_local_id = prev_scope.next_local_id, .all_code_paths_return = false, .is_loop_block = is_loop });
+	context.lexical_scopes.push_back({ .next_local_id = next_local_id, .all_code_paths_return = false, .is_loop_block = is_loop });
 }
 
 instance::compilation_context::lexical_scope instance::unwind_lexical_scope(instance::compilation_context& context) {
+	context.emit_release_scoped_tables();
+
 	//emit unwind locals instruction
 	if (context.lexical_scopes.back().declared_locals.size() > 0) {
 		context.emit({ .operation = opcode::UNWIND_LOCALS, .operand = static_cast<operand>(context.lexical_scopes.back().declared_locals.size()) });
@@ -731,8 +791,11 @@ instance::compilation_context::lexical_scope instance::unwind_lexical_scope(inst
 	for (auto hash : context.lexical_scopes.back().declared_locals) {
 		context.active_variables.erase(context.active_variables.find(hash));
 	}
+	for (auto hash : context.lexical_scopes.back().scoped_tables) {
+		context.scoped_tables.erase(hash);
+	}
 
-	compilation_context::lexical_scope scope = context.lexical_scopes.back();
+	compilation_context::lexical_scope scope = std::move(context.lexical_scopes.back());
 	context.lexical_scopes.pop_back();
 
 	if (scope.declared_locals.size() > 0) {
@@ -775,14 +838,102 @@ uint32_t instance::compile_function(compilation_context& context, std::string na
 	}
 	context.tokenizer.scan_token();
 
-	if (qualifiers.contains(token_type::NO_CAPTURE)) { 
+	bool no_capture = qualifiers.contains(token_type::NO_CAPTURE);
+	if (no_capture) { 
 		if (is_class_method) {
 			context.panic("Class Error: The no_capture annotation is invalid in a class method.");
 		}
 	}
 
+	//a top-level function that can't capture only sees the variables declared before it, so it's body can wait until it's called
+	if (context.lazy_source != nullptr && context.function_decls.empty() && (no_capture || is_class_method)) {
+		if (context.variables_snapshot == nullptr) {
+			context.variables_snapshot = std::make_shared<const phmap::btree_map<size_t, compilation_context::variable>>(context.active_variables);
+			//the stubs keep the source and the snapshot alive until they're collected
+			allocated_since_collect += context.lazy_source->size() + context.active_variables.size() * sizeof(compilation_context::variable);
+		}
+
+		function_entry stub(name, 0, 0, static_cast<operand>(param_names.size()));
+		uint32_t id = add_function(context, stub);
+		count_function_allocation(0, 0);
+		allocated_since_collect += sizeof(lazy_function);
+		lazy_functions.insert({ id, {
+			.source = context.lazy_source,
+			.body = context.tokenizer,
+			.location = context.tokenizer.last_tok_begin(),
+			.mode = context.mode,
+			.parent_module = context.parent_module,
+			.optimization_level = context.optimization_level,
+			.variables = context.variables_snapshot,
+			.param_names = param_names,
+			.no_capture = no_capture,
+			.is_class_method = is_class_method,
+			.is_constructor = is_constructor,
+			.requires_super_call = requires_super_call
+		} });
+
+		context.tokenizer.skip_block();
+		context.tokenizer.exit_function();
+		context.tokenizer.scan_token();
+
+		if (!is_class_method) {
+			context.emit_function_operation(qualifiers.contains(token_type::VARIADIC) ? opcode::CAPTURE_VARIADIC_FUNCPTR : opcode::CAPTURE_FUNCPTR, id);
+		}
+		return id;
+	}
+
+	compile_function_body(context, name, param_names, no_capture, is_class_method, is_constructor, requires_super_call);
+	context.tokenizer.exit_function();
+	context.tokenizer.scan_token();
+
+	auto captured_vars = context.function_decls.back().captured_variables;
+	if (captured_vars.empty() && !no_capture && !is_class_method) {
+		std::stringstream ss;
+		ss << "Function Warning: Function " << name << " doesn't capture any variables. Consider adding the no_capture annotation for enhanced performance.";
+		context.make_warning(ss.str());
+	}
+
+	//add instructions to instance
+	uint32_t id = emit_finalize_function(context);
+
+	static opcode operations[] = {
+		opcode::CAPTURE_FUNCPTR,
+		opcode::CAPTURE_CLOSURE,
+		opcode::CAPTURE_VARIADIC_FUNCPTR,
+		opcode::CAPTURE_VARIADIC_CLOSURE
+	};
+	int op_no = 0;
+	if (!no_capture) {
+		op_no += 1;
+	}
+	if (qualifiers.contains(token_type::VARIADIC)) {
+		op_no += 2;
+	}
+
+	opcode operation = operations[op_no];
+	if (!no_capture && !is_class_method) {
+		context.emit({.operation = opcode::ALLOCATE_TABLE_LITERAL, .operand = static_cast<operand>(captured_vars.size())});
+		for (auto captured_variable : captured_vars) {
+			context.emit({ .operation = opcode::DUPLICATE_TOP });
+			emit_load_property(Hash::dj2b(captured_variable.c_str()), context);
+			emit_load_variable(captured_variable, context);
+
+			context.emit({ .operation = opcode::STORE_TABLE, .operand = 0 });
+			context.emit({ .operation = opcode::DISCARD_TOP });
+		}
+	}
+
+	if (!is_class_method) {
+		context.emit_function_operation(operation, id);
+	}
+
+	return id;
+}
+
+void instance::compile_function_body(compilation_context& context, std::string name, const std::vector<std::string>& param_names, bool no_capture, bool is_class_method, bool is_constructor, bool requires_super_call, token_type end_token) {
 	context.lexical_scopes.push_back({ .next_local_id = 0, .is_loop_block = false });
-	context.function_decls.push_back({ .name = name, .id = context.function_decls.size(), .param_count = static_cast<operand>(param_names.size()), .no_capture = qualifiers.contains(token_type::NO_CAPTURE), .is_class_method = is_class_method });
+	context.code_buffers.emplace_back();
+	context.function_decls.push_back({ .name = name, .id = context.function_decls.size(), .param_count = static_cast<operand>(param_names.size()), .no_capture = no_capture, .is_class_method = is_class_method });
 
 	if (!is_constructor) {
 		for (std::string param_name : param_names) {
@@ -790,7 +941,7 @@ uint32_t instance::compile_function(compilation_context& context, std::string na
 		}
 	}
 
-	if (!qualifiers.contains(token_type::NO_CAPTURE)) {
+	if (!no_capture) {
 		if (is_constructor) {
 			if (requires_super_call) {
 				context.alloc_and_store("super", true);
@@ -822,89 +973,62 @@ uint32_t instance::compile_function(compilation_context& context, std::string na
 		}
 	}
 
-	while (!context.tokenizer.match_token(token_type::END_BLOCK, true))
+	while (!context.tokenizer.match_token(end_token, true))
 	{
 		compile_statement(context);
 	}
-	context.tokenizer.exit_function();
-	context.tokenizer.scan_token();
 
 	if (!context.lexical_scopes.back().all_code_paths_return) {
+		context.emit_release_scoped_tables();
 		context.emit({ .operation = opcode::PUSH_NIL });
 		context.emit({ .operation = opcode::RETURN });
 	}
 
-	auto captured_vars = context.function_decls.back().captured_variables;
-	if (captured_vars.empty() && !qualifiers.contains(token_type::NO_CAPTURE) && !is_class_method) {
-		std::stringstream ss;
-		ss << "Function Warning: Function " << name << " doesn't capture any variables. Consider adding the no_capture annotation for enhanced performance.";
-		context.make_warning(ss.str());
-	}
-
 	//remove declared locals from active variables
 	for (auto hash : context.lexical_scopes.back().declared_locals) {
 		context.active_variables.erase(context.active_variables.find(hash));
 	}
-
-	//add instructions to instance
-	uint32_t id = emit_finalize_function(context);
-
-	static opcode operations[] = {
-		opcode::CAPTURE_FUNCPTR,
-		opcode::CAPTURE_CLOSURE,
-		opcode::CAPTURE_VARIADIC_FUNCPTR,
-		opcode::CAPTURE_VARIADIC_CLOSURE
-	};
-	int op_no = 0;
-	if (!qualifiers.contains(token_type::NO_CAPTURE)) {
-		op_no += 1;
-	}
-	if (qualifiers.contains(token_type::VARIADIC)) {
-		op_no += 2;
-	}
-
-	opcode operation = operations[op_no];
-	if (!qualifiers.contains(token_type::NO_CAPTURE) && !is_class_method) {
-		context.emit({.operation = opcode::ALLOCATE_TABLE_LITERAL, .operand = static_cast<operand>(captured_vars.size())});
-		for (auto captured_variable : captured_vars) {
-			context.emit({ .operation = opcode::DUPLICATE_TOP });
-			emit_load_property(Hash::dj2b(captured_variable.c_str()), context);
-			emit_load_variable(captured_variable, context);
-
-			context.emit({ .operation = opcode::STORE_TABLE, .operand = 0 });
-			context.emit({ .operation = opcode::DISCARD_TOP });
-		}
-	}
-
-	if (!is_class_method) {
-		context.emit_function_operation(operation, id);
+	for (auto hash : context.lexical_scopes.back().scoped_tables) {
+		context.scoped_tables.erase(hash);
 	}
-
-	return id;
 }
 
-uint32_t instance::emit_finalize_function(compilation_context& context) {
-	compilation_context::lexical_scope scope = context.lexical_scopes.back();
+uint32_t instance::emit_finalize_function(compilation_context& context, std::optional<uint32_t> lazy_id) {
+	compilation_context::lexical_scope scope = std::move(context.lexical_scopes.back());
 	context.lexical_scopes.pop_back();
+	compilation_context::code_buffer code = std::move(context.code_buffers.back());
+	context.code_buffers.pop_back();
+	optimize_code(context, code);
 
-	size_t start_addr = instructions.size();
-	if (scope.declared_locals.size() > 0) {
-		instructions.push_back({ .operation = opcode::PROBE_LOCALS, .operand = static_cast<operand>(scope.declared_locals.size()) });
+	bool probe_locals = scope.declared_locals.size() > 0;
+	size_t length = code.instructions.size() + (probe_locals ? 1 : 0);
+	size_t start_addr = allocate_code(length);
+	if (probe_locals) {
+		instructions[start_addr] = { .operation = opcode::PROBE_LOCALS, .operand = static_cast<operand>(scope.declared_locals.size()) };
 	}
 
-	size_t offset = instructions.size();
-	instructions.insert(instructions.end(), scope.instructions.begin(), scope.instructions.end());
-	for (auto src_loc : scope.ip_src_map) {
+	size_t offset = start_addr + (probe_locals ? 1 : 0);
+	std::copy(code.instructions.begin(), code.instructions.end(), instructions.begin() + offset);
+	for (auto src_loc : code.ip_src_map) {
 		this->ip_src_map.insert(std::make_pair(src_loc.first + offset, src_loc.second));
 	}
+	count_function_allocation(length, code.ip_src_map.size());
 
 	compilation_context::function_declaration& function_decl = context.function_decls.back();
-	function_entry function(function_decl.name, start_addr, instructions.size() - start_addr, function_decl.param_count);
+	function_entry function(function_decl.name, start_addr, length, function_decl.param_count);
 	compilation_context::function_declaration func_decl = context.function_decls.back();
 	function.referenced_constants = std::vector<uint32_t>(func_decl.refed_constants.begin(), func_decl.refed_constants.end());
 	function.referenced_functions = std::vector<uint32_t>(func_decl.refed_functions.begin(), func_decl.refed_functions.end());
 	context.function_decls.pop_back();
 
+	if (lazy_id.has_value()) {
+		functions.at(lazy_id.value()) = function;
+		return lazy_id.value();
+	}
+	return add_function(context, function);
+}
+
+uint32_t instance::add_function(compilation_context& context, function_entry function) {
 	uint32_t id;
 	if (available_function_ids.empty()) {
 		id = next_function_id++;
@@ -924,6 +1048,59 @@ uint32_t instance::emit_finalize_function(compilation_context& context) {
 	return id;
 }
 
+size_t instance::compile_lazy_function(uint32_t id) {
+	const lazy_function& lazy = lazy_functions.at(id);
+
+	tokenizer tokenizer = lazy.body;
+	compilation_context context = {
+		.mode = lazy.mode,
+		.parent_module = lazy.parent_module,
+		.optimization_level = lazy.optimization_level,
+		.active_variables = *lazy.variables,
+		.tokenizer = tokenizer,
+		.current_src_pos = { lazy.location }
+	};
+	context.lexical_scopes.push_back({ .next_local_id = 0, .all_code_paths_return = false, .is_loop_block = false }); //stands in for the top-level scope the function was declared in
+
+	try {
+		compile_function_body(context, functions.at(id).name, lazy.param_names, lazy.no_capture, lazy.is_class_method, lazy.is_constructor, lazy.requires_super_call);
+	}
+	catch (const compilation_error& error) {
+		//the call already pushed the function's frame; pop it so the call site isn't listed twice in the traceback
+		return_stack.pop_back();
+		local_offset -= extended_offsets.back();
+		extended_offsets.pop_back();
+		panic(error.to_print_string());
+	}
+	emit_finalize_function(context, id);
+
+	lazy_functions.erase(id);
+	return functions.at(id).start_address;
+}
+
+uint32_t instance::compile_prepared(compilation_context& context, const std::vector<std::string>& parameters) {
+	context.current_src_pos.push_back(context.tokenizer.last_tok_begin());
+	if (parameters.size() > UINT8_MAX) {
+		context.panic("Function Error: Parameter count cannot exceed 255.");
+	}
+
+	//a prepared script runs as a function, so top-level locals are out of it's reach
+	context.lexical_scopes.push_back({ .next_local_id = 0, .all_code_paths_return = false, .is_loop_block = false });
+	operand global_offset = 0;
+	for (auto name_hash : global_vars) {
+		context.active_variables.insert({ name_hash, {
+			.name_hash = name_hash,
+			.is_global = true,
+			.offset = global_offset,
+			.func_id = 0
+		} });
+		global_offset++;
+	}
+
+	compile_function_body(context, "prepared script", parameters, true, false, false, false, token_type::END_OF_SOURCE);
+	return emit_finalize_function(context);
+}
+
 void instance::compile_class(compilation_context& context) {
 	context.tokenizer.expect_token(token_type::CLASS);
 	auto class_begin_loc = context.tokenizer.last_tok_begin();
@@ -989,6 +1166,7 @@ void instance::compile_class(compilation_context& context) {
 	context.tokenizer.scan_token();
 
 	context.lexical_scopes.push_back({ .next_local_id = 0, .is_loop_block = false });
+	context.code_buffers.emplace_back();
 	context.function_decls.push_back({ .name = class_name, .id = context.function_decls.size(), .no_capture = !(inherits_class || default_value_stack.size() > 0), .is_class_method = false });
 	context.set_src_loc(class_begin_loc);
 	if (constructor.has_value()) {
@@ -1115,6 +1293,7 @@ void instance::compile_class(compilation_context& context) {
 }
 
 void instance::compile(compilation_context& context) {
+	context.code_buffers.emplace_back();
 	if (context.mode == compile_mode::COMPILE_MODE_LIBRARY) {
 		context.lexical_scopes.push_back({ .next_local_id = 0, .all_code_paths_return = false, .is_loop_block = false });
 		context.global_offset = global_vars.size();
@@ -1155,7 +1334,7 @@ void instance::compile(compilation_context& context) {
 		"library"
 	};
 
-	context.emit_load_constant(add_constant(value(value(const_cast<char*>(mode_strs[context.mode])))), repl_used_constants);
+	context.emit_load_constant(add_constant(make_string(mode_strs[context.mode])), repl_used_constants);
 	if (context.active_variables.contains(Hash::dj2b("@hulamode"))) {
 		if (context.active_variables.at(Hash::dj2b("@hulamode")).is_global) {
 			operand offset = context.active_variables.at(Hash::dj2b("@hulamode")).offset;
@@ -1221,6 +1400,7 @@ void instance::compile(compilation_context& context) {
 		emit_load_property(context.parent_module.value(), context);
 		context.emit({ .operation = opcode::LOAD_MODULE });
 		context.emit({ .operation = opcode::FINALIZE_TABLE });
+		context.emit({ .operation = opcode::STOP }); //module code may be placed before other code
 		//context.emit({ .operation = opcode::UNWIND_GLOBALS, .operand = 1 });
 	}
 	else {
@@ -1229,11 +1409,15 @@ void instance::compile(compilation_context& context) {
 		global_vars.insert(global_vars.end(), context.declared_globals.begin(), context.declared_globals.end());
 	}
 
-	ip = instructions.size();
-	instructions.insert(instructions.end(), context.lexical_scopes.back().instructions.begin(), context.lexical_scopes.back().instructions.end());
+	optimize_code(context, context.code_buffers.back());
+	auto& top_level_ins = context.code_buffers.back().instructions;
+	ip = allocate_code(top_level_ins.size());
+	std::copy(top_level_ins.begin(), top_level_ins.end(), instructions.begin() + ip);
+	top_level_code.push_back(std::make_pair(ip, top_level_ins.size())); //top-level code only runs once, so it's released when it finishes
 
-	for (auto src_loc : context.lexical_scopes.back().ip_src_map) {
+	for (auto src_loc : context.code_buffers.back().ip_src_map) {
 		this->ip_src_map.insert(std::make_pair(src_loc.first + ip, src_loc.second));
 	}
 	context.lexical_scopes.pop_back();
+	context.code_buffers.pop_back();
 }
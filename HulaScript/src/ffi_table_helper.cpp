@@ -54,7 +54,7 @@ void HulaScript::ffi_table_helper::emplace(std::string key, instance::value set_
 }
 
 void HulaScript::ffi_table_helper::reserve(size_t capacity, bool allow_collect) {
-	instance::table& table_entry = owner_instance.tables.at(table_id);
+	instance::table& table_entry = this->table_entry();
 
 	if (table_entry.block.capacity < capacity) {
 		owner_instance.reallocate_table(table_id, capacity, allow_collect);
@@ -66,7 +66,7 @@ void HulaScript::ffi_table_helper::append(instance::value value, bool allow_coll
 		owner_instance.panic("Cannot add to an immutable table.", ERROR_IMMUTABLE);
 	}
 
-	instance::table& table_entry = owner_instance.tables.at(table_id);
+	instance::table& table_entry = this->table_entry();
 
 	if (table_entry.count == table_entry.block.capacity) {
 		if (allow_collect) {
@@ -78,8 +78,7 @@ void HulaScript::ffi_table_helper::append(instance::value value, bool allow_coll
 		}
 	}
 
-	instance::value index_val(static_cast<double>(table_entry.count));
-	table_entry.key_hashes.insert({ index_val.hash<true>(), table_entry.count });
+	table_entry.key_hashes.insert({ owner_instance.rational_integer(table_entry.count).hash<true>(), table_entry.count });
 	owner_instance.heap[table_entry.block.start + table_entry.count] = value;
 	table_entry.count++;
 }
@@ -89,7 +88,7 @@ bool HulaScript::ffi_table_helper::remove(instance::value value) {
 		owner_instance.panic("Cannot add to an immutable table.", ERROR_IMMUTABLE);
 	}
 
-	instance::table& table_entry = owner_instance.tables.at(table_id);
+	instance::table& table_entry = this->table_entry();
 
 	auto it = table_entry.key_hashes.find(value.hash<true>());
 	if (it == table_entry.key_hashes.end()) {
@@ -99,8 +98,9 @@ bool HulaScript::ffi_table_helper::remove(instance::value value) {
 	size_t remove_index = it->second;
 	table_entry.key_hashes.erase(it);
 
-	auto dest = owner_instance.heap.begin() + remove_index;
-	std::move(dest + 1, owner_instance.heap.end(), dest);
+	for (size_t index = remove_index + 1; index < table_entry.count; index++) {
+		owner_instance.heap[table_entry.block.start + index - 1] = owner_instance.heap[table_entry.block.start + index];
+	}
 
 	if (is_array()) {
 		for (size_t index = remove_index + 1; index < table_entry.count; index++) {
@@ -50,16 +50,16 @@ void instance::compile_for_loop(compilation_context& context) {
 	size_t jump_end_dest_ip = context.current_ip();
 
 	for (auto continue_request : scope2.continue_requests) {
-		context.set_instruction(continue_request + scope2.final_ins_offset, opcode::JUMP_BACK, (continue_request + scope2.final_ins_offset) - continue_dest_ip);
+		context.set_instruction(continue_request, opcode::JUMP_BACK, continue_request - continue_dest_ip);
 	}
-	context.set_operand(jump_end_ins_addr + scope2.final_ins_offset, jump_end_dest_ip - (jump_end_ins_addr + scope2.final_ins_offset));
+	context.set_operand(jump_end_ins_addr, jump_end_dest_ip - jump_end_ins_addr);
 
 	if (context.tokenizer.match_token(token_type::ELSE)) {
 		context.tokenizer.scan_token();
 
 		size_t jump_past_else_ins_addr = context.emit({ .operation = opcode::JUMP_AHEAD });
 		for (auto break_request : scope2.break_requests) {
-			context.set_operand(break_request + scope2.final_ins_offset, context.current_ip() - (break_request + scope2.final_ins_offset));
+			context.set_operand(break_request, context.current_ip() - break_request);
 		}
 
 		compile_block(context);
@@ -71,7 +71,7 @@ void instance::compile_for_loop(compilation_context& context) {
 		context.tokenizer.scan_token();
 
 		for (auto break_request : scope2.break_requests) {
-			context.set_operand(break_request + scope2.final_ins_offset, context.current_ip() - (break_request + scope2.final_ins_offset));
+			context.set_operand(break_request, context.current_ip() - break_request);
 		}
 	}
 
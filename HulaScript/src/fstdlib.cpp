@@ -2,10 +2,10 @@
 #include "ffi.hpp"
 #include "table_iterator.hpp"
 #include <cstdint>
+#include <charconv>
 #include <memory>
 #include <random>
 #include <iostream>
-#include <fstream>
 #include <sstream>
 
 using namespace HulaScript;
@@ -38,8 +38,10 @@ private:
 
 class int_range : public foreign_method_object<int_range> {
 public:
-	int_range(int64_t start, int64_t stop, int64_t step) : start(start), stop(stop), step(step) {
-		declare_method("iterator", &int_range::get_iterator);
+	int_range(int64_t start, int64_t stop, int64_t step) : start(start), stop(stop), step(step) { }
+
+	static void declare_methods(method_table& table) {
+		declare_method(table, "iterator", &int_range::get_iterator);
 	}
 
 private:
@@ -48,7 +50,7 @@ private:
 	int64_t stop;
 
 	instance::value get_iterator(std::vector<instance::value>& arguments, instance& instance) {
-		return instance.add_foreign_object(std::make_unique<int_range_iterator>(int_range_iterator(start, stop, step)));
+		return instance.add_pooled_foreign_object<int_range_iterator>(start, stop, step);
 	}
 };
 
@@ -61,8 +63,155 @@ private:
 		return instance::value(unif_real(rng));
 	}
 public:
-	random_generator(double lower_bound, double upper_bound) : unif_real(lower_bound, upper_bound) {
-		declare_method("next", &random_generator::next_real);
+	random_generator(double lower_bound, double upper_bound) : unif_real(lower_bound, upper_bound) { }
+
+	static void declare_methods(method_table& table) {
+		declare_method(table, "next", &random_generator::next_real);
+	}
+};
+
+//accumulates text in a growable buffer, so building a string out of many pieces takes linear time
+class string_builder : public foreign_method_object<string_builder> {
+public:
+	string_builder(std::vector<instance::value>& initial, instance& instance) {
+		append(initial, instance);
+	}
+
+	static void declare_methods(method_table& table) {
+		declare_method(table, "append", &string_builder::append);
+		declare_method(table, "toString", &string_builder::to_hula_string);
+		declare_method(table, "length", &string_builder::length);
+		declare_method(table, "clear", &string_builder::clear);
+	}
+
+private:
+	std::string buffer;
+
+	instance::value append(std::vector<instance::value>& arguments, instance& instance) {
+		for (auto& argument : arguments) {
+			if (argument.check_type(instance::value::vtype::STRING)) {
+				buffer.append(argument.str_view(instance));
+			}
+			else {
+				buffer.append(instance.get_value_print_string(argument));
+			}
+		}
+		return instance::value(static_cast<foreign_object*>(this));
+	}
+
+	instance::value to_hula_string(std::vector<instance::value>& arguments, instance& instance) {
+		EXPECT_ARGS(0);
+		return instance.make_string(buffer);
+	}
+
+	instance::value length(std::vector<instance::value>& arguments, instance& instance) {
+		EXPECT_ARGS(0);
+		return instance.rational_integer(static_cast<int64_t>(buffer.size()));
+	}
+
+	instance::value clear(std::vector<instance::value>& arguments, instance& instance) {
+		EXPECT_ARGS(0);
+		buffer.clear();
+		return instance::value(static_cast<foreign_object*>(this));
+	}
+
+	std::string to_string() override {
+		return buffer;
+	}
+};
+
+//references a value without keeping it alive; the collector resets it to nil once nothing else references the value
+class weak_ref : public foreign_method_object<weak_ref> {
+public:
+	weak_ref(instance::value target) : target(target) {
+		gc_tag = gc_kind::GC_KIND_WEAK;
+	}
+
+	static void declare_methods(method_table& table) {
+		declare_method(table, "get", &weak_ref::get);
+		declare_method(table, "alive", &weak_ref::alive);
+	}
+
+private:
+	instance::value target;
+
+	instance::value get(std::vector<instance::value>& arguments, instance& instance) {
+		EXPECT_ARGS(0);
+		return target;
+	}
+
+	instance::value alive(std::vector<instance::value>& arguments, instance& instance) {
+		EXPECT_ARGS(0);
+		return instance::value(!target.check_type(instance::value::vtype::NIL));
+	}
+
+	void clear_dead_references(const std::function<bool(const instance::value&)>& is_alive) override {
+		if (!is_alive(target)) {
+			target = instance::value();
+		}
+	}
+
+	std::string to_string() override {
+		return "weak reference";
+	}
+};
+
+//a map whose entries are removed by the collector once either the key or the value is otherwise unreachable
+class weak_table : public foreign_method_object<weak_table> {
+public:
+	weak_table() {
+		gc_tag = gc_kind::GC_KIND_WEAK;
+	}
+
+	static void declare_methods(method_table& table) {
+		declare_method(table, "get", &weak_table::get);
+		declare_method(table, "set", &weak_table::set);
+		declare_method(table, "has", &weak_table::has);
+		declare_method(table, "remove", &weak_table::remove);
+		declare_method(table, "count", &weak_table::count);
+	}
+
+private:
+	phmap::flat_hash_map<size_t, std::pair<instance::value, instance::value>> entries;
+
+	instance::value get(std::vector<instance::value>& arguments, instance& instance) {
+		EXPECT_ARGS(1);
+		auto it = entries.find(arguments[0].hash<true>());
+		if (it == entries.end()) {
+			return instance::value();
+		}
+		return it->second.second;
+	}
+
+	instance::value set(std::vector<instance::value>& arguments, instance& instance) {
+		EXPECT_ARGS(2);
+		entries.insert_or_assign(arguments[0].hash<true>(), std::make_pair(arguments[0], arguments[1]));
+		return arguments[1];
+	}
+
+	instance::value has(std::vector<instance::value>& arguments, instance& instance) {
+		EXPECT_ARGS(1);
+		return instance::value(entries.contains(arguments[0].hash<true>()));
+	}
+
+	instance::value remove(std::vector<instance::value>& arguments, instance& instance) {
+		EXPECT_ARGS(1);
+		return instance::value(entries.erase(arguments[0].hash<true>()) > 0);
+	}
+
+	instance::value count(std::vector<instance::value>& arguments, instance& instance) {
+		EXPECT_ARGS(0);
+		return instance.rational_integer(static_cast<int64_t>(entries.size()));
+	}
+
+	void clear_dead_references(const std::function<bool(const instance::value&)>& is_alive) override {
+		phmap::erase_if(entries, [&is_alive](const auto& entry) -> bool {
+			return !is_alive(entry.second.first) || !is_alive(entry.second.second);
+		});
+	}
+
+	std::string to_string() override {
+		return "weak table";
 	}
 };
 
@@ -98,7 +247,7 @@ static instance::value new_int_range(std::vector<instance::value> arguments, ins
 		}
 	}
 	
-	return instance.add_foreign_object(std::make_unique<int_range>(int_range(start, stop, step)));
+	return instance.add_pooled_foreign_object<int_range>(start, stop, step);
 }
 
 static instance::value new_random_generator(std::vector<instance::value> arguments, instance& instance) {
@@ -114,6 +263,20 @@ static instance::value new_random_generator(std::vector<instance::value> argumen
 	return instance.add_foreign_object(std::make_unique<random_generator>(random_generator(lower_bound, upper_bound)));
 }
 
+static instance::value new_string_builder(std::vector<instance::value> arguments, instance& instance) {
+	return instance.add_foreign_object(std::make_unique<string_builder>(arguments, instance));
+}
+
+static instance::value new_weak_ref(std::vector<instance::value> arguments, instance& instance) {
+	EXPECT_ARGS(1);
+	return instance.add_foreign_object(std::make_unique<weak_ref>(arguments[0]));
+}
+
+static instance::value new_weak_table(std::vector<instance::value> arguments, instance& instance) {
+	EXPECT_ARGS(0);
+	return instance.add_foreign_object(std::make_unique<weak_table>());
+}
+
 static instance::value parse_rational_str(std::vector<instance::value> arguments, instance& instance) {
 	EXPECT_ARGS(1);
 	return instance.parse_rational(arguments.at(0).str(instance));
@@ -284,20 +447,7 @@ instance::value HulaScript::append_range(instance::value table_value, instance::
 
 static instance::value import_module(std::vector<instance::value>& arguments, instance& instance) {
 	EXPECT_ARGS(1);
-
-	std::ifstream infile(arguments.at(0).str(instance));
-	if (infile.fail()) { //file probably not found
-		return instance::value();
-	}
-	
-	std::string s;
-	std::string line;
-	while (std::getline(infile, line)) {
-		s.append(line);
-		s.push_back('\n');
-	}
-
-	return instance.load_module_from_source(s, arguments.at(0).str(instance));
+	return instance.load_module_from_file(arguments.at(0).str(instance));
 }
 
 static instance::value user_panic(std::vector<instance::value>& arguments, instance& instance) {
@@ -326,13 +476,21 @@ static instance::value import_foreign_module(std::vector<instance::value>& argum
 }
 #endif // HULASCRIPT_USE_SHARED_LIBRARY
 
+//numbers are rationals, unless they're too long or precise to be one; neither case throws
 static instance::value standard_number_parser(std::string str, const instance& instance) {
-	try {
-		return instance.parse_rational(str);
+	auto rational = instance.try_parse_rational(str);
+	if (rational.has_value()) {
+		return rational.value();
 	}
-	catch(const runtime_error& err) {
-		return instance::value(std::stod(str));
+
+	double number;
+	auto res = std::from_chars(str.data(), str.data() + str.size(), number);
+	if (res.ec != std::errc()) {
+		std::stringstream ss;
+		ss << "Numerical Error: Cannot parse numerical string \"" << str << "\".";
+		instance.panic(ss.str(), ERROR_INVALID_ARGUMENT);
 	}
+	return instance::value(number);
 }
 
 instance::instance(custom_numerical_parser numerical_parser) : numerical_parser(numerical_parser) {
@@ -342,6 +500,9 @@ instance::instance(custom_numerical_parser numerical_parser) : numerical_parser(
 
 	declare_global("irange", make_foreign_function(new_int_range));
 	declare_global("randomer", make_foreign_function(new_random_generator));
+	declare_global("stringBuilder", make_foreign_function(new_string_builder));
+	declare_global("weakref", make_foreign_function(new_weak_ref));
+	declare_global("weakTable", make_foreign_function(new_weak_table));
 
 	declare_global("sort", make_foreign_function(sort_table));
 	declare_global("binarySearch", make_foreign_function(binary_search_table));
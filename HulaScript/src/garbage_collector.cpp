@@ -1,67 +1,370 @@
 #include <algorithm>
 #include <cstdlib>
+#include <new>
 #include "HulaScript.hpp"
-#ifdef HULASCRIPT_USE_SHARED_LIBRARY
-#include "table_iterator.hpp"
-#endif // HULASCRIPT_USE_SHARED_LIBRARY
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif // _WIN32
 
 using namespace HulaScript;
 
+size_t instance::segmented_heap::allocate_large(size_t capacity) {
+	capacity = round_to_slot(capacity);
+	size_t bytes = capacity * sizeof(value);
+
+	//fresh mappings are zero filled, which is already a nil value
+#ifdef _WIN32
+	void* mapping = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (mapping == nullptr) {
+		throw std::bad_alloc();
+	}
+#else
+	void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+#endif // _WIN32
+
+	value* elems = static_cast<value*>(mapping);
+	size_t start = reserve_slots(elems, capacity);
+	large_objects.insert({ start, large_object{.elems = elems, .capacity = capacity } });
+	large_elems_count += capacity;
+	return start;
+}
+
+void instance::segmented_heap::free_large(size_t address) {
+	auto it = large_objects.find(address);
+	assert(it != large_objects.end());
+
+#ifdef _WIN32
+	VirtualFree(it->second.elems, 0, MEM_RELEASE);
+#else
+	munmap(it->second.elems, it->second.capacity * sizeof(value));
+#endif // _WIN32
+
+	release_slots(address, it->second.capacity);
+	large_elems_count -= it->second.capacity;
+	large_objects.erase(it);
+}
+
+instance::segmented_heap::~segmented_heap() {
+	while (!large_objects.empty()) {
+		free_large(large_objects.begin()->first);
+	}
+}
+
+void instance::string_arena::add_page(size_t size_class) {
+	size_t slot_size = SLOT_SIZES[size_class];
+	pages.push_back({ .memory = std::unique_ptr<char[]>(new char[PAGE_SIZE]), .size_class = size_class });
+
+	char* memory = pages.back().memory.get();
+	for (size_t offset = 0; offset + slot_size <= PAGE_SIZE; offset += slot_size) {
+		gc_string* slot = reinterpret_cast<gc_string*>(memory + offset);
+		slot->gc_mark = gc_string::FREE_MARK;
+		next_free(slot) = free_slots[size_class];
+		free_slots[size_class] = slot;
+	}
+}
+
+instance::gc_string* instance::string_arena::allocate_large(size_t length) {
+	gc_string* str = static_cast<gc_string*>(::operator new(sizeof(gc_string) + length + 1));
+	str->length = static_cast<uint32_t>(length);
+	str->gc_mark = 0;
+	large_strings.push_back(str);
+	return str;
+}
+
+void instance::string_arena::sweep(uint32_t epoch) {
+	//free lists are rebuilt from scratch, which leaves out the slots of released pages
+	free_slots.fill(nullptr);
+	for (size_t i = 0; i < pages.size();) {
+		size_t slot_size = SLOT_SIZES[pages[i].size_class];
+		char* memory = pages[i].memory.get();
+
+		bool has_live = false;
+		for (size_t offset = 0; offset + slot_size <= PAGE_SIZE; offset += slot_size) {
+			gc_string* slot = reinterpret_cast<gc_string*>(memory + offset);
+			if (slot->gc_mark == epoch) {
+				has_live = true;
+			}
+			else {
+				slot->gc_mark = gc_string::FREE_MARK;
+			}
+		}
+
+		if (!has_live) {
+			std::swap(pages[i], pages.back());
+			pages.pop_back();
+			continue;
+		}
+
+		for (size_t offset = 0; offset + slot_size <= PAGE_SIZE; offset += slot_size) {
+			gc_string* slot = reinterpret_cast<gc_string*>(memory + offset);
+			if (slot->gc_mark == gc_string::FREE_MARK) {
+				next_free(slot) = free_slots[pages[i].size_class];
+				free_slots[pages[i].size_class] = slot;
+			}
+		}
+		i++;
+	}
+
+	for (size_t i = 0; i < large_strings.size();) {
+		if (large_strings[i]->gc_mark != epoch) {
+			::operator delete(large_strings[i]);
+			large_strings[i] = large_strings.back();
+			large_strings.pop_back();
+		}
+		else {
+			i++;
+		}
+	}
+}
+
+instance::string_arena::~string_arena() {
+	for (gc_string* str : large_strings) {
+		::operator delete(str);
+	}
+}
+
 instance::gc_block instance::allocate_block(size_t capacity, bool allow_collect) {
-	auto it = free_blocks.lower_bound(capacity);
-	if (it != free_blocks.end()) {
-		gc_block block = it->second;
-		it = free_blocks.erase(it);
-		return block;
+	allocated_since_collect += capacity * sizeof(value);
+
+	if (capacity >= large_table_threshold) {
+		if (heap.committed() + capacity >= heap_collect_threshold && allow_collect) {
+			garbage_collect();
+		}
+		return gc_block(heap.allocate_large(capacity), capacity);
+	}
+
+	if (capacity == 0) {
+		return gc_block(heap.size(), 0);
+	}
+
+	auto it = free_block_sizes.lower_bound(std::make_pair(capacity, static_cast<size_t>(0)));
+	if (it != free_block_sizes.end()) {
+		gc_block block(it->second, it->first);
+		unlink_free_block(block);
+		if (block.capacity > capacity) {
+			release_block(gc_block(block.start + capacity, block.capacity - capacity));
+		}
+		return gc_block(block.start, capacity);
+	}
+
+	if (heap.available() < capacity) {
+		if (heap.committed() + capacity >= heap_collect_threshold && allow_collect) {
+			garbage_collect();
+		}
+
+		if (heap.available() < capacity) {
+			if (heap.available() > 0) {
+				release_block(gc_block(heap.size(), heap.available()));
+			}
+			heap.grow(capacity);
+		}
+	}
+
+	return gc_block(heap.allocate(capacity), capacity);
+}
+
+void instance::release_block(gc_block block) {
+	if (block.capacity == 0) {
+		return;
+	}
+
+	//merge with free neighbours, but never across a chunk boundary
+	auto next = free_blocks.find(block.start + block.capacity);
+	if (next != free_blocks.end() && !heap.is_chunk_start(next->first)) {
+		gc_block next_block(next->first, next->second);
+		unlink_free_block(next_block);
+		block.capacity += next_block.capacity;
+	}
+	auto prev = free_blocks.lower_bound(block.start);
+	if (prev != free_blocks.begin() && !heap.is_chunk_start(block.start)) {
+		prev--;
+		if (prev->first + prev->second == block.start) {
+			gc_block prev_block(prev->first, prev->second);
+			unlink_free_block(prev_block);
+			block = gc_block(prev_block.start, prev_block.capacity + block.capacity);
+		}
+	}
+
+	//hand space at the top of the heap back to the bump allocator
+	if (block.start + block.capacity == heap.size() && !heap.is_chunk_start(heap.size())) {
+		heap.retract(block.start);
+		return;
+	}
+
+	free_blocks.insert({ block.start, block.capacity });
+	free_block_sizes.insert(std::make_pair(block.capacity, block.start));
+}
+
+void instance::unlink_free_block(gc_block block) noexcept {
+	free_blocks.erase(block.start);
+	free_block_sizes.erase(std::make_pair(block.capacity, block.start));
+}
+
+size_t instance::allocate_code(size_t length) {
+	auto it = free_code_sizes.lower_bound(std::make_pair(length, static_cast<size_t>(0)));
+	if (it != free_code_sizes.end()) {
+		size_t start = it->second;
+		size_t free_length = it->first;
+		free_code_sizes.erase(it);
+		free_code_blocks.erase(start);
+		if (free_length > length) {
+			free_code_blocks.insert({ start + length, free_length - length });
+			free_code_sizes.insert(std::make_pair(free_length - length, start + length));
+		}
+		return start;
+	}
+
+	size_t start = instructions.size();
+	instructions.resize(start + length);
+	return start;
+}
+
+void instance::release_code(size_t start, size_t length) {
+	if (length == 0) {
+		return;
+	}
+	ip_src_map.erase(ip_src_map.lower_bound(start), ip_src_map.lower_bound(start + length));
+
+	auto next = free_code_blocks.find(start + length);
+	if (next != free_code_blocks.end()) {
+		length += next->second;
+		free_code_sizes.erase(std::make_pair(next->second, next->first));
+		free_code_blocks.erase(next);
+	}
+	auto prev = free_code_blocks.lower_bound(start);
+	if (prev != free_code_blocks.begin()) {
+		prev--;
+		if (prev->first + prev->second == start) {
+			start = prev->first;
+			length += prev->second;
+			free_code_sizes.erase(std::make_pair(prev->second, prev->first));
+			free_code_blocks.erase(prev);
+		}
+	}
+
+	//the last span of instructions is never free; it's given back instead
+	if (start + length == instructions.size()) {
+		instructions.erase(instructions.begin() + start, instructions.end());
+		return;
+	}
+
+	free_code_blocks.insert({ start, length });
+	free_code_sizes.insert(std::make_pair(length, start));
+}
+
+void instance::release_retired_code() {
+	if (call_depth > 0) {
+		return;
+	}
+	for (auto code : retired_code) {
+		release_code(code.first, code.second);
+	}
+	retired_code.clear();
+}
+
+bool instance::extend_block(gc_block& block, size_t new_capacity) noexcept {
+	size_t end = block.start + block.capacity;
+	size_t extra = new_capacity - block.capacity;
+
+	//an empty block owns no memory, so it may start anywhere
+	if (block.capacity > 0 && heap.is_chunk_start(end)) {
+		return false;
+	}
+
+	if (heap.try_extend(end, extra)) {
+		block.capacity = new_capacity;
+		allocated_since_collect += extra * sizeof(value);
+		return true;
 	}
 
-	if (heap.size() + capacity >= heap.capacity() && allow_collect) {
-		garbage_collect(false);
+	auto next = free_blocks.find(end);
+	if (next != free_blocks.end() && next->second >= extra) {
+		gc_block next_block(next->first, next->second);
+		unlink_free_block(next_block);
+		if (next_block.capacity > extra) {
+			free_blocks.insert({ end + extra, next_block.capacity - extra });
+			free_block_sizes.insert(std::make_pair(next_block.capacity - extra, end + extra));
+		}
+		block.capacity = new_capacity;
+		allocated_since_collect += extra * sizeof(value);
+		return true;
 	}
 
-	gc_block block(heap.size(), capacity);
-	heap.insert(heap.end(), capacity, value());
-	return block;
+	return false;
 }
 
 size_t instance::allocate_table(size_t capacity, bool allow_collect) {
-	table t(allocate_block(capacity, allow_collect));
+	gc_block block = allocate_block(capacity, allow_collect);
 
 	if (available_table_ids.empty()) {
-		tables.insert({ next_table_id, t });
-		next_table_id++;
-		return next_table_id - 1;
+		tables.push_back(table(block));
+		return tables.size() - 1;
 	}
 	else {
 		size_t id = available_table_ids.back();
 		available_table_ids.pop_back();
-		tables.insert({ id, t });
+
+		table& t = tables[id];
+		assert(!t.is_alive);
+		t.block = block;
+		t.count = 0;
+		t.is_alive = true;
 		return id;
 	}
 }
 
 void instance::reallocate_table(size_t table_id, size_t new_capacity, bool allow_collect) {
-	table& t = tables.at(table_id);
+	table& t = get_table(table_id);
 
 	if (new_capacity > t.block.capacity) {
+		//grow in place into the top of the heap, or a free block right after the table
+		if (new_capacity < large_table_threshold && !heap.is_large(t.block) && extend_block(t.block, new_capacity)) {
+			return;
+		}
+
 		gc_block block = allocate_block(new_capacity, allow_collect);
-		auto start_it = heap.begin() + t.block.start;
-		std::move(start_it, start_it + t.count, heap.begin() + block.start);
+		heap.move(t.block.start, block.start, t.count);
 
-		if (block.capacity > 0) {
-			free_blocks.insert({ t.block.capacity, t.block });
+		if (heap.is_large(t.block)) {
+			heap.free_large(t.block.start);
+		}
+		else {
+			release_block(t.block);
 		}
 		t.block = block;
 	}
-	else if (new_capacity < t.block.capacity) {
+	else if (new_capacity < t.block.capacity && !heap.is_large(t.block)) {
 		gc_block block = gc_block(t.block.start + new_capacity, t.block.capacity - new_capacity);
 		t.block.capacity = new_capacity;
-		free_blocks.insert({ block.capacity, block });
+		release_block(block);
 	}
 }
 
-void instance::garbage_collect(bool compact_instructions) noexcept {
+void instance::free_table(size_t table_id) {
+	table& t = tables[table_id];
+	if (heap.is_large(t.block)) {
+		heap.free_large(t.block.start);
+	}
+	else {
+		release_block(t.block);
+	}
+	t.key_hashes.clear();
+	t.is_alive = false;
+	t.generation++;
+	available_table_ids.push_back(table_id);
+}
+
+void instance::garbage_collect() noexcept {
+	allocated_since_collect = 0;
+
 	std::vector<value> values_to_trace;
 	std::vector<uint32_t> functions_to_trace;
 
@@ -69,24 +372,24 @@ void instance::garbage_collect(bool compact_instructions) noexcept {
 	values_to_trace.insert(values_to_trace.end(), globals.begin(), globals.end());
 	values_to_trace.insert(values_to_trace.end(), locals.begin(), locals.end());
 	values_to_trace.insert(values_to_trace.end(), temp_gc_exempt.begin(), temp_gc_exempt.end());
+	values_to_trace.insert(values_to_trace.end(), root_slots.begin(), root_slots.end());
 	for (auto id : repl_used_constants) {
 		assert((constants[id].flags & value::vflags::INVALID_CONSTANT) == 0);
 		values_to_trace.push_back(constants[id]);
 	}
 
-	phmap::flat_hash_set<size_t> marked_tables;
+	gc_epoch++;
+	if (gc_epoch == 0 || gc_epoch == gc_string::FREE_MARK) { //skip the marks new objects and free string slots carry
+		gc_epoch = 1;
+	}
+
+	std::vector<bool> marked_tables(tables.size(), false);
 	phmap::flat_hash_set<uint32_t> marked_functions;
-	phmap::flat_hash_set<char*> marked_strs;
 	phmap::flat_hash_set<uint32_t> marked_constants;
-	phmap::flat_hash_set<foreign_object*> marked_foreign_objects;
 	phmap::flat_hash_set<uint32_t> marked_foreign_functions;
 
 	functions_to_trace.insert(functions_to_trace.end(), repl_used_functions.begin(), repl_used_functions.end());
 	marked_constants.insert(repl_used_constants.begin(), repl_used_constants.end());
-	/*for (foreign_object* permanent_foreign_object : permanent_foreign_objs) {
-		marked_foreign_objects.insert(permanent_foreign_object);
-		permanent_foreign_object->trace(values_to_trace);
-	}*/
 
 	while (!values_to_trace.empty() || !functions_to_trace.empty()) //trace values 
 	{
@@ -103,9 +406,9 @@ void instance::garbage_collect(bool compact_instructions) noexcept {
 				}
 				[[fallthrough]];
 			case value::vtype::TABLE: {
-				table& table = tables.at(to_trace.data.id);
-				if (!marked_tables.contains(to_trace.data.id)) {
-					marked_tables.insert(to_trace.data.id);
+				table& table = get_table(to_trace.data.id);
+				if (!marked_tables[to_trace.data.id]) {
+					marked_tables[to_trace.data.id] = true;
 					for (size_t i = 0; i < table.count; i++) {
 						values_to_trace.push_back(heap[i + table.block.start]);
 					}
@@ -113,20 +416,25 @@ void instance::garbage_collect(bool compact_instructions) noexcept {
 				break;
 			}
 			case value::vtype::STRING:
-				marked_strs.insert(to_trace.data.str);
+				if (!(to_trace.flags & value::vflags::STRING_IS_INLINE)) {
+					gc_string::from_chars(to_trace.data.str)->gc_mark = gc_epoch;
+				}
 				break;
 			case value::vtype::FOREIGN_OBJECT_METHOD:
 				[[fallthrough]];
 			case value::vtype::FOREIGN_OBJECT: {
-				marked_foreign_objects.insert(to_trace.data.foreign_object);
-				to_trace.data.foreign_object->trace(values_to_trace);
+				foreign_object* obj = to_trace.data.foreign_object;
+				if (obj->gc_mark != gc_epoch) {
+					obj->gc_mark = gc_epoch;
+					obj->trace(values_to_trace);
+				}
 				break;
+			}
 			case value::vtype::FOREIGN_FUNCTION: {
 				marked_foreign_functions.insert(to_trace.function_id);
 				break;
 			}
 			}
-			}
 		}
 
 		while (!functions_to_trace.empty()) //trace functions
@@ -147,19 +455,50 @@ void instance::garbage_collect(bool compact_instructions) noexcept {
 		}
 	}
 
+	//weak objects drop the values nothing else kept alive
+	auto is_alive = [&](const value& to_check) -> bool {
+		switch (to_check.type)
+		{
+		case value::vtype::CLOSURE:
+			if (!marked_functions.contains(to_check.function_id)) {
+				return false;
+			}
+			return !(to_check.flags & value::vflags::HAS_CAPTURE_TABLE) || marked_tables[to_check.data.id];
+		case value::vtype::TABLE:
+			return marked_tables[to_check.data.id];
+		case value::vtype::STRING:
+			return (to_check.flags & value::vflags::STRING_IS_INLINE) || gc_string::from_chars(to_check.data.str)->gc_mark == gc_epoch;
+		case value::vtype::FOREIGN_OBJECT_METHOD:
+			[[fallthrough]];
+		case value::vtype::FOREIGN_OBJECT:
+			return to_check.data.foreign_object->gc_mark == gc_epoch;
+		case value::vtype::FOREIGN_FUNCTION:
+			return marked_foreign_functions.contains(to_check.function_id);
+		default:
+			return true;
+		}
+	};
+	for (foreign_object* obj = foreign_objs; obj != nullptr; obj = obj->gc_next) {
+		if (obj->gc_tag == foreign_object::gc_kind::GC_KIND_WEAK && obj->gc_mark == gc_epoch) {
+			obj->clear_dead_references(is_alive);
+		}
+	}
+
 	//remove unused table entries
-	for (auto it = tables.begin(); it != tables.end(); ) {
-		auto id = it->first;
-		if (!marked_tables.contains(id)) {
+	for (size_t id = 0; id < tables.size(); id++) {
+		table& table = tables[id];
+		if (table.is_alive && !marked_tables[id]) {
+			if (heap.is_large(table.block)) {
+				heap.free_large(table.block.start);
+			}
+			table.key_hashes.clear();
+			table.is_alive = false;
+			table.generation++;
 			available_table_ids.push_back(id);
-			it = tables.erase(it);
-		}
-		else {
-			it++;
 		}
 	}
 	for (auto it = loaded_modules.begin(); it != loaded_modules.end(); ) {
-		if (!marked_tables.contains(it->second)) {
+		if (!marked_tables[it->second]) {
 			it = loaded_modules.erase(it);
 		}
 		else {
@@ -174,50 +513,42 @@ void instance::garbage_collect(bool compact_instructions) noexcept {
 				continue;
 			}
 
-			size_t hash = constants[i].hash<false>();
-			constant_hashes.erase(hash);
+			auto it = constant_hashes.find(constants[i].hash<false>());
+			if (it != constant_hashes.end() && it->second == i) {
+				constant_hashes.erase(it);
+			}
 			available_constant_ids.push_back(i);
 
 			constants[i].flags |= value::vflags::INVALID_CONSTANT;
 		}
 	}
 
-	//removed unused strings
-	for (auto it = active_strs.begin(); it != active_strs.end();) {
-		if (!marked_strs.contains(it->get())) {
-			it = active_strs.erase(it);
-		}
-		else {
-			it++;
-		}
-	}
-
-	//removed unused foreign objects
-#ifdef HULASCRIPT_USE_SHARED_LIBRARY
-	std::vector<phmap::btree_set<std::unique_ptr<foreign_object>>::iterator> libraries_to_remove;
-#endif // HULASCRIPT_USE_SHARED_LIBRARY
-	for (auto it = foreign_objs.begin(); it != foreign_objs.end();) {
-		auto ptr = it->get();
-		if (!marked_foreign_objects.contains(ptr)) {
-#ifdef HULASCRIPT_USE_SHARED_LIBRARY
-			foreign_imported_library* library_obj = dynamic_cast<foreign_imported_library*>(ptr);
-			if (library_obj != nullptr) {
-				libraries_to_remove.push_back(it);
-				it++;
-				continue;
+	//removed unused strings; the intern set holds them weakly
+	phmap::erase_if(interned_strs, [this](gc_string* str) -> bool {
+		return str->gc_mark != gc_epoch;
+	});
+	strings.sweep(gc_epoch);
+
+	//removed unused foreign objects; imported libraries go last, since the other objects may depend on their code
+	std::vector<foreign_object*> libraries_to_remove;
+	for (foreign_object** link = &foreign_objs; *link != nullptr;) {
+		foreign_object* obj = *link;
+		if (obj->gc_mark != gc_epoch) {
+			*link = obj->gc_next;
+			if (obj->gc_tag == foreign_object::gc_kind::GC_KIND_IMPORTED_LIBRARY) {
+				libraries_to_remove.push_back(obj);
+			}
+			else {
+				free_foreign_object(obj);
 			}
-#endif
-			it = foreign_objs.erase(it);
 		}
 		else {
-			it++;
+			link = &obj->gc_next;
 		}
 	}
-#ifdef HULASCRIPT_USE_SHARED_LIBRARY
-	for (auto it : libraries_to_remove) {
-		foreign_objs.erase(it);
+	for (foreign_object* library : libraries_to_remove) {
+		delete library;
 	}
-#endif // HULASCRIPT_USE_SHARED_LIBRARY
 
 	for (auto it = foreign_functions.begin(); it != foreign_functions.end();) {
 		if (!marked_foreign_functions.contains(it->first)) {
@@ -230,100 +561,140 @@ void instance::garbage_collect(bool compact_instructions) noexcept {
 		}
 	}
 
-	//sort tables by block start position
-	std::vector<size_t> sorted_tables(marked_tables.begin(), marked_tables.end());
+	//sort tables by block start position; large tables are never moved
+	std::vector<size_t> sorted_tables;
+	for (size_t id = 0; id < tables.size(); id++) {
+		if (marked_tables[id] && !heap.is_large(tables[id].block)) {
+			sorted_tables.push_back(id);
+		}
+	}
 	std::sort(sorted_tables.begin(), sorted_tables.end(), [this](size_t a, size_t b) -> bool {
-		return tables.at(a).block.start < tables.at(b).block.start;
+		return tables[a].block.start < tables[b].block.start;
 	});
 
-	//compact tables
-	size_t table_offset = 0;
-	for (auto table_id : sorted_tables) {
-		table& table = tables.at(table_id);
-		table.block.capacity = table.count;
+	//find the free space between live tables; tables keep their slack capacity
+	std::vector<gc_block> gaps;
+	size_t free_elems = 0;
+	if (heap.chunk_count() > 0) {
+		size_t chunk_index = 0;
+		gc_block chunk = heap.chunk_at(0);
+		size_t gap_start = chunk.start;
+
+		auto close_chunk = [&]() {
+			//the unallocated tail of the current chunk is left to the bump allocator
+			size_t chunk_end = (heap.size() >= chunk.start && heap.size() <= chunk.start + chunk.capacity) ? heap.size() : chunk.start + chunk.capacity;
+			if (chunk_end > gap_start) {
+				gaps.push_back(gc_block(gap_start, chunk_end - gap_start));
+				free_elems += chunk_end - gap_start;
+			}
+			chunk_index++;
+			if (chunk_index < heap.chunk_count()) {
+				chunk = heap.chunk_at(chunk_index);
+				gap_start = chunk.start;
+			}
+		};
 
-		if (table_offset == table.block.start) {
-			table_offset += table.count;
-			continue;
+		for (auto table_id : sorted_tables) {
+			gc_block& block = tables[table_id].block;
+			if (block.capacity == 0) {
+				continue;
+			}
+
+			while (block.start >= chunk.start + chunk.capacity) {
+				close_chunk();
+			}
+			if (block.start > gap_start) {
+				gaps.push_back(gc_block(gap_start, block.start - gap_start));
+				free_elems += block.start - gap_start;
+			}
+			gap_start = block.start + block.capacity;
 		}
+		while (chunk_index < heap.chunk_count()) {
+			close_chunk();
+		}
+	}
 
-		auto start_it = heap.begin() + table.block.start;
-		std::move(start_it, start_it + table.count, heap.begin() + table_offset);
+	free_blocks.clear();
+	free_block_sizes.clear();
+	if (free_elems * COMPACT_FREE_FRACTION <= heap.chunk_elems()) {
+		//fragmentation is low; sweep only, and hand the gaps back to the free list
+		for (auto gap : gaps) {
+			free_blocks.insert({ gap.start, gap.capacity });
+			free_block_sizes.insert(std::make_pair(gap.capacity, gap.start));
+		}
+	}
+	else {
+		//compact tables; a table never straddles two chunks, so skipped chunk tails become free blocks
+		size_t chunk_index = 0;
+		size_t table_offset = heap.chunk_count() > 0 ? heap.chunk_at(0).start : 0;
+		for (auto table_id : sorted_tables) {
+			table& table = tables[table_id];
+			if (table.block.capacity == 0) {
+				continue;
+			}
+
+			gc_block chunk = heap.chunk_at(chunk_index);
+			while (table_offset + table.block.capacity > chunk.start + chunk.capacity) {
+				if (chunk.start + chunk.capacity > table_offset) {
+					free_blocks.insert({ table_offset, chunk.start + chunk.capacity - table_offset });
+					free_block_sizes.insert(std::make_pair(chunk.start + chunk.capacity - table_offset, table_offset));
+				}
+				chunk_index++;
+				chunk = heap.chunk_at(chunk_index);
+				table_offset = chunk.start;
+			}
 
-		table.block.start = table_offset;
-		table_offset += table.count;
+			if (table_offset != table.block.start) {
+				heap.move(table.block.start, table_offset, table.count);
+				table.block.start = table_offset;
+			}
+			table_offset += table.block.capacity;
+		}
+		heap.truncate(chunk_index, table_offset);
+		free_elems = 0;
+		for (auto& free_block : free_blocks) {
+			free_elems += free_block.second;
+		}
 	}
-	heap.erase(heap.begin() + table_offset, heap.end());
-	free_blocks.clear();
+	heap_collect_threshold = std::max((heap.committed() - free_elems - heap.available()) * 2, segmented_heap::MAX_CHUNK_SIZE);
 
-	//removed unused functions
+	//removed unused functions, handing their code back to the code allocator
 	for (auto it = functions.begin(); it != functions.end();) {
 		if (!marked_functions.contains(it->first)) {
-			//erase src locations within the ip range of the function entry
-			for (auto it2 = ip_src_map.lower_bound(it->second.start_address); it2 != ip_src_map.lower_bound(it->second.start_address + it->second.length); it2 = ip_src_map.erase(it2)) { }
-
-			//erase function entry and make id available
+			if (call_depth == 0) {
+				release_code(it->second.start_address, it->second.length);
+			}
+			else { //an unreferenced function may still be running, so it's code is kept until execution finishes
+				retired_code.push_back(std::make_pair(it->second.start_address, it->second.length));
+			}
 			available_function_ids.push_back(it->first);
+			lazy_functions.erase(it->first);
 			it = functions.erase(it);
 		}
 		else {
 			it++;
 		}
 	}
-
-	//compact instructions after removing unused functions
-	if (compact_instructions) {
-		size_t ip = 0; //sort functions by start address
-		std::vector<uint32_t> sorted_functions(marked_functions.begin(), marked_functions.end());
-		std::sort(sorted_functions.begin(), sorted_functions.end(), [this](uint32_t a, uint32_t b) -> bool {
-			return functions.at(a).start_address < functions.at(b).start_address;
-		});
-
-		for (auto function_id : sorted_functions) {
-			function_entry& function = functions.at(function_id);
-
-			if (function.start_address == ip) {
-				ip += function.length;
-				continue;
-			}
-
-			auto start_it = instructions.begin() + function.start_address;
-			std::move(start_it, start_it + function.length, instructions.begin() + ip);
-			
-			std::vector<std::pair<size_t, source_loc>> to_reinsert;
-			size_t offset = function.start_address - ip;
-			for (auto it = ip_src_map.lower_bound(function.start_address); it != ip_src_map.lower_bound(function.start_address + function.length);) {
-				to_reinsert.push_back(std::make_pair(it->first - offset, it->second));
-				it = ip_src_map.erase(it);
-			}
-			for (auto src_loc : to_reinsert) {
-				ip_src_map.insert(src_loc);
-			}
-
-			function.start_address = ip;
-			ip += function.length;
-		}
-		instructions.erase(instructions.begin() + ip, instructions.end());
-		ip = instructions.size();
-	}
 }
 
-#ifdef HULASCRIPT_USE_SHARED_LIBRARY
-instance::~instance() {//removed unused foreign objects
-	std::vector<phmap::btree_set<std::unique_ptr<foreign_object>>::iterator> libraries_to_remove;
-	for (auto it = foreign_objs.begin(); it != foreign_objs.end();) {
-		auto ptr = it->get();
-		foreign_imported_library* library_obj = dynamic_cast<foreign_imported_library*>(ptr);
-		if (library_obj != nullptr) {
-			libraries_to_remove.push_back(it);
-			it++;
+instance::~instance() {
+	std::vector<foreign_object*> libraries_to_remove;
+	while (foreign_objs != nullptr) {
+		foreign_object* obj = foreign_objs;
+		foreign_objs = obj->gc_next;
+		if (obj->gc_tag == foreign_object::gc_kind::GC_KIND_IMPORTED_LIBRARY) {
+			libraries_to_remove.push_back(obj);
 		}
 		else {
-			it = foreign_objs.erase(it);
+			free_foreign_object(obj);
 		}
 	}
-	for (auto it : libraries_to_remove) {
-		foreign_objs.erase(it);
+	for (foreign_object* library : libraries_to_remove) {
+		delete library;
+	}
+	for (auto& pool : foreign_object_pool) {
+		for (void* memory : pool) {
+			::operator delete(memory);
+		}
 	}
 }
-#endif // HULASCRIPT_USE_SHARED_LIBRARY
\ No newline at end of file
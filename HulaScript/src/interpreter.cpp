@@ -113,7 +113,7 @@ restart_execution:
 				size_t table_id = table_value.data.id;
 
 				for (;;) {
-					table& table = tables.at(table_id);
+					table& table = get_table(table_id);
 
 					auto it = table.key_hashes.find(hash);
 					if (it != table.key_hashes.end()) {
@@ -175,7 +175,7 @@ restart_execution:
 				size_t hash = key.hash<true>();
 
 				for (;;) {
-					table& table = tables.at(table_id);
+					table& table = get_table(table_id);
 					auto it = table.key_hashes.find(hash);
 					if (it != table.key_hashes.end()) {
 						if (flags & value::vflags::TABLE_IS_FINAL) {
@@ -244,21 +244,30 @@ restart_execution:
 				temp_gc_exempt.push_back(evaluation_stack.back());
 				break;
 			}
+			case opcode::RELEASE_LOCAL_TABLE: {
+				value& local = locals[local_offset + ins.operand];
+				if (local.check_type(value::vtype::TABLE)) {
+					free_table(local.data.id);
+					local = value();
+				}
+				break;
+			}
 			case opcode::FINALIZE_TABLE: {
 				expect_type(value::vtype::TABLE);
 				size_t table_id = evaluation_stack.back().data.id;
 
 				if (evaluation_stack.back().flags & value::vflags::TABLE_IS_MODULE) {
-					for (auto it = temp_gc_exempt.begin(); it != temp_gc_exempt.end(); it++) {
+					//temp_gc_exempt is used as a stack, so the module's entry is normally on top
+					for (auto it = temp_gc_exempt.rbegin(); it != temp_gc_exempt.rend(); it++) {
 						if (it->check_type(value::vtype::TABLE) && it->data.id == table_id) {
-							it = temp_gc_exempt.erase(it);
+							temp_gc_exempt.erase(std::next(it).base());
 							break;
 						}
 					}
 				}
 				evaluation_stack.back().flags |= value::vflags::TABLE_IS_FINAL;
 
-				reallocate_table(table_id, tables.at(table_id).count, true);
+				reallocate_table(table_id, get_table(table_id).count, true);
 
 				break;
 			}
@@ -348,6 +357,10 @@ restart_execution:
 				evaluation_stack.pop_back();
 				value a = evaluation_stack.back();
 				evaluation_stack.pop_back();
+				if (a.type == value::vtype::STRING && b.type == value::vtype::STRING) { //strings are inlined or interned
+					evaluation_stack.push_back(value(a.same_string(b)));
+					break;
+				}
 				evaluation_stack.push_back(value(a.hash<false>() == b.hash<false>()));
 				break;
 			}
@@ -356,6 +369,10 @@ restart_execution:
 				evaluation_stack.pop_back();
 				value a = evaluation_stack.back();
 				evaluation_stack.pop_back();
+				if (a.type == value::vtype::STRING && b.type == value::vtype::STRING) { //strings are inlined or interned
+					evaluation_stack.push_back(value(!a.same_string(b)));
+					break;
+				}
 				evaluation_stack.push_back(value(a.hash<false>() != b.hash<false>()));
 				break;
 			}
@@ -410,7 +427,7 @@ restart_execution:
 					ins.operand = 1;
 				}
 				else {
-					table& table = tables.at(table_value.data.id);
+					table& table = get_table(table_value.data.id);
 					for (size_t i = 0; i < table.count; i++) {
 						evaluation_stack.push_back(heap[table.block.start + i]);
 					}
@@ -442,7 +459,7 @@ restart_execution:
 						temp_gc_exempt.push_back(call_value);
 						size_t arg_table_id = allocate_table(ins.operand, true);
 						temp_gc_exempt.pop_back();
-						table& arg_table_entry = tables.at(arg_table_id);
+						table& arg_table_entry = get_table(arg_table_id);
 						arg_table_entry.count = ins.operand;
 
 						for (int i = ins.operand - 1; i >= 0; i--) {
@@ -461,7 +478,7 @@ restart_execution:
 					if (call_value.flags & value::vflags::HAS_CAPTURE_TABLE) {
 						locals.push_back(value(value::vtype::TABLE, value::vflags::NONE, 0, call_value.data.id));
 					}
-					ip = function.start_address;
+					ip = function.length > 0 ? function.start_address : compile_lazy_function(call_value.function_id);
 					continue;
 				}
 				case value::vtype::FOREIGN_OBJECT_METHOD: {
@@ -483,7 +500,7 @@ restart_execution:
 						panic("Array table iterator expects exactly 0 arguments.", ERROR_UNEXPECTED_ARGUMENT_COUNT);
 					}
 
-					evaluation_stack.push_back(add_foreign_object(std::make_unique<table_iterator>(table_iterator(value(value::vtype::TABLE, call_value.flags, 0, call_value.data.id), *this))));
+					evaluation_stack.push_back(add_pooled_foreign_object<table_iterator>(value(value::vtype::TABLE, call_value.flags, 0, call_value.data.id), *this));
 					break;
 				}
 				case value::vtype::INTERNAL_TABLE_FILTER: {
@@ -507,6 +524,7 @@ restart_execution:
 					
 					HulaScript::ffi_table_helper helper(call_value.data.id, call_value.flags, *this);
 					helper.append(argument, true);
+					evaluation_stack.push_back(argument);
 					break;
 				}
 				case value::vtype::INTERNAL_TABLE_APPEND_RANGE: {
@@ -553,7 +571,7 @@ restart_execution:
 
 				function_entry& function = functions.at(id);
 
-				ip = function.start_address;
+				ip = function.length > 0 ? function.start_address : compile_lazy_function(id);
 				continue;
 			}
 			case opcode::RETURN:
@@ -636,12 +654,13 @@ restart_execution:
 				locals.erase(locals.begin() + try_handler.local_size, locals.end());
 				evaluation_stack.erase(evaluation_stack.begin() + try_handler.eval_stack_size, evaluation_stack.end());
 
-				evaluation_stack.push_back(add_foreign_object(std::make_unique<handled_error>(error)));
+				evaluation_stack.push_back(add_pooled_foreign_object<handled_error>(error));
 
 				try_handlers.pop_back();
 				goto restart_execution;
 			}
 		}
+		call_depth--;
 		throw;
 	}
 	
@@ -649,20 +668,24 @@ restart_execution:
 }
 
 void HulaScript::instance::execute_arbitrary(const std::vector<instruction>& arbitrary_ins) {
-	size_t start_ip = instructions.size();
 	size_t old_ip = ip;
-	instructions.insert(instructions.end(), arbitrary_ins.begin(), arbitrary_ins.end());
+	size_t start_ip = allocate_code(arbitrary_ins.size() + 1);
+	std::copy(arbitrary_ins.begin(), arbitrary_ins.end(), instructions.begin() + start_ip);
+	instructions[start_ip + arbitrary_ins.size()] = { .operation = opcode::STOP };
 
-	auto src_loc = src_from_ip(old_ip);
-	if (src_loc.has_value()) {
-		ip_src_map.insert({ start_ip, src_loc.value() });
-	}
+	//ip is only meaningful while a script is running; a call from the host has no source location
+	ip_src_map.insert({ start_ip, call_depth > 0 ? src_from_ip(old_ip) : std::nullopt });
 
 	ip = start_ip;
-	execute();
+	try {
+		execute();
+	}
+	catch (...) {
+		release_code(start_ip, arbitrary_ins.size() + 1);
+		throw;
+	}
 
-	for (auto it = ip_src_map.lower_bound(start_ip); it != ip_src_map.end(); it = ip_src_map.erase(it)) { }
-	instructions.erase(instructions.begin() + start_ip, instructions.end());
+	release_code(start_ip, arbitrary_ins.size() + 1);
 	ip = old_ip;
 }
 
@@ -301,29 +301,18 @@ void instance::handle_double_exponentiate(value& a, value& b) {
 }
 
 void instance::handle_string_add(value& a, value& b) {
-	size_t a_len = strlen(a.data.str);
+	if (b.check_type(value::vtype::STRING)) {
+		evaluation_stack.push_back(concat_strings(a.chars_view(), b.chars_view()));
+		return;
+	}
 
 	std::string b_str = get_value_print_string(b);
-
-	auto alloc = std::unique_ptr<char[]>(new char[a_len + b_str.size() + 1]);
-	strcpy(alloc.get(), a.data.str);
-	strcpy(alloc.get() + a_len, b_str.data());
-
-	evaluation_stack.push_back(value(alloc.get()));
-	active_strs.insert(std::move(alloc));
+	evaluation_stack.push_back(concat_strings(a.chars_view(), b_str));
 }
 
 void instance::handle_string_add2(value& a, value& b) {
-	size_t b_len = strlen(b.data.str);
-
 	std::string a_str = get_value_print_string(a);
-
-	auto alloc = std::unique_ptr<char[]>(new char[b_len + a_str.size() + 1]);
-	strcpy(alloc.get(), a_str.data());
-	strcpy(alloc.get() + a_str.size(), b.data.str);
-
-	evaluation_stack.push_back(value(alloc.get()));
-	active_strs.insert(std::move(alloc));
+	evaluation_stack.push_back(concat_strings(a_str, b.chars_view()));
 }
 
 void instance::handle_table_add(value& a, value& b) {
@@ -335,12 +324,12 @@ void instance::handle_table_add(value& a, value& b) {
 	temp_gc_exempt.push_back(a);
 	temp_gc_exempt.push_back(b);
 
-	size_t table_id = allocate_table(tables.at(a.data.id).count + tables.at(b.data.id).count, true);
-	table& a_table = tables.at(a.data.id);
-	table& b_table = tables.at(b.data.id);
-	table& allocated = tables.at(table_id);
+	size_t table_id = allocate_table(get_table(a.data.id).count + get_table(b.data.id).count, true);
+	table& a_table = get_table(a.data.id);
+	table& b_table = get_table(b.data.id);
+	table& allocated = get_table(table_id);
 	
-	allocated.count = allocated.block.capacity;
+	allocated.count = a_table.count + b_table.count;
 	for (size_t i = 0; i < a_table.count; i++) {
 		heap[allocated.block.start + i] = heap[a_table.block.start + i];
 	}
@@ -362,11 +351,11 @@ void instance::handle_table_repeat(value& a, value& b) {
 	}
 	size_t len = a.index(0, INT64_MAX, *this);
 
-	size_t table_id = allocate_table(len * tables.at(b.data.id).count, true);
-	table& existing = tables.at(b.data.id);
-	table& allocated = tables.at(table_id);
+	size_t table_id = allocate_table(len * get_table(b.data.id).count, true);
+	table& existing = get_table(b.data.id);
+	table& allocated = get_table(table_id);
 	
-	allocated.count = allocated.block.capacity;
+	allocated.count = len * existing.count;
 	for (size_t i = 0; i < len; i++) {
 		for (size_t j = 0; j < existing.count; j++) {
 			heap[allocated.block.start + (i * existing.count + j)] = heap[existing.block.start + j];
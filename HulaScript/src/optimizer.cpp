@@ -0,0 +1,419 @@
+#include "HulaScript.hpp"
+
+using namespace HulaScript;
+
+bool instance::code_node::has_payload(opcode operation) noexcept {
+	return operation == opcode::LOAD_CONSTANT || operation == opcode::CALL_LABEL || (operation >= opcode::CAPTURE_FUNCPTR && operation <= opcode::CAPTURE_VARIADIC_CLOSURE);
+}
+
+std::optional<bool> instance::code_node::jump_direction() const noexcept {
+	switch (ins.operation)
+	{
+	case opcode::JUMP_AHEAD:
+	case opcode::IF_FALSE_JUMP_AHEAD:
+	case opcode::IFNT_NIL_JUMP_AHEAD:
+	case opcode::TRY_HANDLE_ERROR:
+		return true;
+	case opcode::JUMP_BACK:
+	case opcode::IF_FALSE_JUMP_BACK:
+		return false;
+	default:
+		return std::nullopt;
+	}
+}
+
+bool instance::code_node::is_unconditional_jump() const noexcept {
+	return ins.operation == opcode::JUMP_AHEAD || ins.operation == opcode::JUMP_BACK;
+}
+
+bool instance::code_node::is_constant_load() const noexcept {
+	return ins.operation == opcode::LOAD_CONSTANT_FAST || ins.operation == opcode::LOAD_CONSTANT;
+}
+
+uint32_t instance::code_node::constant_id() const {
+	if (ins.operation == opcode::LOAD_CONSTANT_FAST) {
+		return ins.operand;
+	}
+
+	uint32_t id = ins.operand;
+	id = (id << 8) + static_cast<uint8_t>(payload.value().operation);
+	id = (id << 8) + payload.value().operand;
+	return id;
+}
+
+std::vector<size_t> instance::code_node::addresses(const std::vector<code_node>& nodes) {
+	std::vector<size_t> addresses(nodes.size() + 1, 0);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		addresses[i + 1] = addresses[i] + (nodes[i].payload.has_value() ? 2 : 1);
+	}
+	return addresses;
+}
+
+//folding across a node some jump lands on would change what the jump executes
+std::vector<bool> instance::code_node::jump_targets(const std::vector<code_node>& nodes) {
+	std::vector<bool> targeted(nodes.size() + 1, false);
+	for (const auto& node : nodes) {
+		if (node.target != SIZE_MAX) {
+			targeted[node.target] = true;
+		}
+	}
+	return targeted;
+}
+
+std::optional<instance::value> instance::fold_constant_operator(opcode operation, value a, value b) {
+	if ((a.type != value::vtype::DOUBLE && a.type != value::vtype::RATIONAL) || (b.type != value::vtype::DOUBLE && b.type != value::vtype::RATIONAL)) {
+		return std::nullopt;
+	}
+	//rationals are raised to integer powers by repeated multiplication, so only small powers are worth doing ahead of time
+	if (operation == opcode::EXPONENTIATE && a.type == value::vtype::RATIONAL && b.type == value::vtype::RATIONAL && (a.data.id == 0 || (b.function_id == 1 && b.data.id > 64))) {
+		return std::nullopt;
+	}
+
+	operator_handler handler = operator_handlers[operator_handler_map[operation - opcode::ADD][a.type - value::vtype::DOUBLE][b.type - value::vtype::DOUBLE]];
+	size_t stack_size = evaluation_stack.size();
+	try {
+		(this->*handler)(a, b);
+	}
+	catch (const HulaScript::runtime_error&) {
+		//overflows and divisions by zero are left to panic when the code runs
+		evaluation_stack.erase(evaluation_stack.begin() + stack_size, evaluation_stack.end());
+		return std::nullopt;
+	}
+
+	value result = evaluation_stack.back();
+	evaluation_stack.pop_back();
+	return result;
+}
+
+bool instance::fold_constants(compilation_context& context, std::vector<code_node>& nodes) {
+	std::vector<bool> targeted = code_node::jump_targets(nodes);
+	bool changed = false;
+
+	for (size_t i = 0; i + 2 < nodes.size(); i++) {
+		opcode operation = nodes[i + 2].ins.operation;
+		if (!nodes[i].is_constant_load() || !nodes[i + 1].is_constant_load() || operation < opcode::ADD || operation > opcode::EXPONENTIATE || targeted[i + 1] || targeted[i + 2]) {
+			continue;
+		}
+
+		auto result = fold_constant_operator(operation, constants[nodes[i].constant_id()], constants[nodes[i + 1].constant_id()]);
+		if (!result.has_value()) {
+			continue;
+		}
+
+		uint32_t const_id = add_constant(result.value());
+		if (!context.function_decls.empty()) {
+			context.function_decls.back().refed_constants.insert(const_id);
+		}
+		else {
+			repl_used_constants.push_back(const_id);
+		}
+
+		if (const_id <= UINT8_MAX) {
+			nodes[i] = { .ins = {.operation = opcode::LOAD_CONSTANT_FAST, .operand = static_cast<operand>(const_id) } };
+		}
+		else {
+			nodes[i] = {
+				.ins = {.operation = opcode::LOAD_CONSTANT, .operand = static_cast<operand>(const_id >> 16) },
+				.payload = instruction{.operation = static_cast<opcode>((const_id >> 8) & 0xFF), .operand = static_cast<operand>(const_id & 0xFF) }
+			};
+		}
+		nodes[i + 1].removed = true;
+		nodes[i + 2].removed = true;
+		changed = true;
+		i += 2;
+	}
+	return changed;
+}
+
+bool instance::fold_constant_branches(std::vector<code_node>& nodes) {
+	std::vector<bool> targeted = code_node::jump_targets(nodes);
+	bool changed = false;
+
+	for (size_t i = 0; i + 1 < nodes.size(); i++) {
+		opcode push = nodes[i].ins.operation;
+		opcode jump = nodes[i + 1].ins.operation;
+		if ((push != opcode::PUSH_TRUE && push != opcode::PUSH_FALSE) || (jump != opcode::IF_FALSE_JUMP_AHEAD && jump != opcode::IF_FALSE_JUMP_BACK) || targeted[i + 1]) {
+			continue;
+		}
+
+		//IF_FALSE_JUMP_BACK jumps when the condition is true
+		if ((push == opcode::PUSH_FALSE) == (jump == opcode::IF_FALSE_JUMP_AHEAD)) {
+			nodes[i] = { .ins = {.operation = (jump == opcode::IF_FALSE_JUMP_AHEAD ? opcode::JUMP_AHEAD : opcode::JUMP_BACK) }, .target = nodes[i + 1].target };
+		}
+		else {
+			nodes[i].removed = true;
+		}
+		nodes[i + 1].removed = true;
+		changed = true;
+		i++;
+	}
+	return changed;
+}
+
+bool instance::drop_discarded_pushes(std::vector<code_node>& nodes) {
+	std::vector<bool> targeted = code_node::jump_targets(nodes);
+	bool changed = false;
+
+	for (size_t i = 0; i + 1 < nodes.size(); i++) {
+		if (nodes[i + 1].ins.operation != opcode::DISCARD_TOP || targeted[i + 1]) {
+			continue;
+		}
+
+		switch (nodes[i].ins.operation)
+		{
+		case opcode::PUSH_NIL:
+		case opcode::PUSH_TRUE:
+		case opcode::PUSH_FALSE:
+		case opcode::LOAD_CONSTANT_FAST:
+		case opcode::LOAD_CONSTANT:
+		case opcode::LOAD_LOCAL:
+		case opcode::LOAD_GLOBAL:
+		case opcode::DUPLICATE_TOP:
+			nodes[i].removed = true;
+			nodes[i + 1].removed = true;
+			changed = true;
+			i++;
+			break;
+		default:
+			break;
+		}
+	}
+	return changed;
+}
+
+bool instance::thread_jumps(std::vector<code_node>& nodes) {
+	std::vector<size_t> addresses = code_node::addresses(nodes);
+	bool changed = false;
+
+	for (size_t i = 0; i < nodes.size(); i++) {
+		code_node& node = nodes[i];
+		if (node.target == SIZE_MAX || node.ins.operation == opcode::TRY_HANDLE_ERROR) {
+			continue;
+		}
+
+		size_t destination = node.target;
+		for (size_t hops = 0; destination < nodes.size() && nodes[destination].is_unconditional_jump() && hops < nodes.size(); hops++) {
+			destination = nodes[destination].target;
+		}
+		if (destination == node.target || destination >= nodes.size() || destination == i || nodes[destination].is_unconditional_jump()) {
+			continue;
+		}
+
+		//removing code later only brings jumps closer, so an offset that fits now keeps fitting
+		bool ahead = destination > i;
+		size_t distance = ahead ? addresses[destination] - addresses[i] : addresses[i] - addresses[destination];
+		if (distance > UINT8_MAX) {
+			continue;
+		}
+		if (node.is_unconditional_jump()) {
+			node.ins.operation = ahead ? opcode::JUMP_AHEAD : opcode::JUMP_BACK;
+		}
+		else if (node.jump_direction().value() != ahead) {
+			continue;
+		}
+
+		node.target = destination;
+		changed = true;
+	}
+	return changed;
+}
+
+bool instance::remove_unreachable_code(std::vector<code_node>& nodes) {
+	std::vector<bool> reachable(nodes.size(), false);
+	std::vector<size_t> to_visit = { 0 };
+	while (!to_visit.empty()) {
+		size_t i = to_visit.back();
+		to_visit.pop_back();
+		if (i >= nodes.size() || reachable[i]) {
+			continue;
+		}
+		reachable[i] = true;
+
+		const code_node& node = nodes[i];
+		if (node.target != SIZE_MAX) {
+			to_visit.push_back(node.target);
+		}
+		if (node.ins.operation != opcode::RETURN && node.ins.operation != opcode::STOP && !node.is_unconditional_jump()) {
+			to_visit.push_back(i + 1);
+		}
+	}
+
+	//the last instruction is kept regardless, since code must end with STOP, RETURN or a jump back
+	bool changed = false;
+	for (size_t i = 0; i + 1 < nodes.size(); i++) {
+		if (!reachable[i]) {
+			nodes[i].removed = true;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+bool instance::remove_redundant_jumps(std::vector<code_node>& nodes) {
+	bool changed = false;
+
+	//going backwards, jumps skipping over jumps removed later in the code are caught too
+	for (size_t i = nodes.size() - 1; i-- > 0; ) {
+		if (nodes[i].ins.operation != opcode::JUMP_AHEAD) {
+			continue;
+		}
+
+		bool skips_code = false;
+		for (size_t j = i + 1; j < nodes[i].target; j++) {
+			if (!nodes[j].removed) {
+				skips_code = true;
+				break;
+			}
+		}
+		if (!skips_code) {
+			nodes[i].removed = true;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+void instance::compact_code(std::vector<code_node>& nodes, std::vector<std::pair<size_t, source_loc>>& src_locs) {
+	//removed nodes map to the node after them, which is where jumps to them end up
+	std::vector<size_t> new_indices(nodes.size() + 1);
+	size_t count = 0;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		new_indices[i] = count;
+		if (!nodes[i].removed) {
+			count++;
+		}
+	}
+	new_indices[nodes.size()] = count;
+
+	std::vector<code_node> compacted;
+	compacted.reserve(count);
+	for (auto& node : nodes) {
+		if (node.removed) {
+			continue;
+		}
+		if (node.target != SIZE_MAX) {
+			node.target = new_indices[node.target];
+		}
+		compacted.push_back(node);
+	}
+	nodes = std::move(compacted);
+
+	//when several locations collapse onto one node, the last one is what applied to it before
+	std::vector<std::pair<size_t, source_loc>> remapped;
+	remapped.reserve(src_locs.size());
+	for (auto& src_loc : src_locs) {
+		size_t index = new_indices[src_loc.first];
+		if (!remapped.empty() && remapped.back().first == index) {
+			remapped.back().second = src_loc.second;
+		}
+		else {
+			remapped.push_back(std::make_pair(index, src_loc.second));
+		}
+	}
+	src_locs = std::move(remapped);
+}
+
+void instance::optimize_code(compilation_context& context, compilation_context::code_buffer& code) {
+	if (context.optimization_level == 0 || code.instructions.empty()) {
+		return;
+	}
+
+	std::vector<code_node> nodes;
+	std::vector<size_t> node_indices(code.instructions.size() + 1, SIZE_MAX);
+	std::vector<size_t> node_addrs;
+	for (size_t addr = 0; addr < code.instructions.size(); addr++) {
+		node_indices[addr] = nodes.size();
+		node_addrs.push_back(addr);
+
+		code_node node = { .ins = code.instructions[addr] };
+		if (code_node::has_payload(node.ins.operation)) {
+			if (addr + 1 >= code.instructions.size()) {
+				return;
+			}
+			addr++;
+			node.payload = code.instructions[addr];
+		}
+		nodes.push_back(node);
+	}
+	node_indices[code.instructions.size()] = nodes.size();
+
+	for (size_t i = 0; i < nodes.size(); i++) {
+		auto direction = nodes[i].jump_direction();
+		if (!direction.has_value()) {
+			continue;
+		}
+
+		size_t operand = nodes[i].ins.operand;
+		if (operand == 0 || (!direction.value() && operand > node_addrs[i])) {
+			return;
+		}
+		size_t target_addr = direction.value() ? node_addrs[i] + operand : node_addrs[i] - operand;
+		if (target_addr > code.instructions.size() || node_indices[target_addr] == SIZE_MAX) {
+			return; //jumps into a payload, so leave the code as is
+		}
+		nodes[i].target = node_indices[target_addr];
+	}
+
+	std::vector<std::pair<size_t, source_loc>> src_locs;
+	src_locs.reserve(code.ip_src_map.size());
+	for (auto& src_loc : code.ip_src_map) {
+		size_t addr = src_loc.first;
+		if (addr < code.instructions.size() && node_indices[addr] == SIZE_MAX) {
+			addr++;
+		}
+		src_locs.push_back(std::make_pair(node_indices[addr], src_loc.second));
+	}
+
+	bool changed;
+	do {
+		changed = false;
+		if (context.optimization_level >= 2 && fold_constants(context, nodes)) {
+			compact_code(nodes, src_locs);
+			changed = true;
+		}
+		if (fold_constant_branches(nodes)) {
+			compact_code(nodes, src_locs);
+			changed = true;
+		}
+		if (drop_discarded_pushes(nodes)) {
+			compact_code(nodes, src_locs);
+			changed = true;
+		}
+		changed |= thread_jumps(nodes);
+		if (remove_unreachable_code(nodes)) {
+			compact_code(nodes, src_locs);
+			changed = true;
+		}
+		if (remove_redundant_jumps(nodes)) {
+			compact_code(nodes, src_locs);
+			changed = true;
+		}
+	} while (changed);
+
+	std::vector<size_t> addresses = code_node::addresses(nodes);
+	std::vector<instruction> optimized;
+	optimized.reserve(addresses.back());
+	for (size_t i = 0; i < nodes.size(); i++) {
+		instruction ins = nodes[i].ins;
+		if (nodes[i].target != SIZE_MAX) {
+			size_t from = addresses[i];
+			size_t to = addresses[nodes[i].target];
+			bool ahead = nodes[i].jump_direction().value();
+			if ((ahead ? to <= from : to >= from) || (ahead ? to - from : from - to) > UINT8_MAX) {
+				return;
+			}
+			ins.operand = static_cast<operand>(ahead ? to - from : from - to);
+		}
+
+		optimized.push_back(ins);
+		if (nodes[i].payload.has_value()) {
+			optimized.push_back(nodes[i].payload.value());
+		}
+	}
+
+	code.instructions = std::move(optimized);
+	code.ip_src_map.clear();
+	for (auto& src_loc : src_locs) {
+		code.ip_src_map.push_back(std::make_pair(addresses[src_loc.first], src_loc.second));
+	}
+}
@@ -233,7 +233,7 @@ std::string instance::get_value_print_string(value to_print_init) {
 				break;
 			}
 			printed_tables.insert({ current.data.id, ss.tellp()});
-			table& table = tables.at(current.data.id);
+			table& table = get_table(current.data.id);
 
 			ss << '[';
 
@@ -256,7 +256,7 @@ std::string instance::get_value_print_string(value to_print_init) {
 			ss << (current.data.boolean ? "true" : "false");
 			break;
 		case value::vtype::STRING:
-			ss << (current.data.str);
+			ss << current.chars_view();
 			break;
 		case value::vtype::DOUBLE:
 			ss << current.data.number;
@@ -182,17 +182,18 @@ void HulaScript::instance::handle_rational_modulo(value& a, value& b) {
 	evaluation_stack.push_back(value(value::vtype::RATIONAL, flags, denom / common_denom, nom / common_denom));
 }
 
-instance::value instance::parse_rational(std::string str) const {
-	uint64_t numerator = 0;
-	uint32_t denominator = 1;
+//parses a rational in one pass without throwing; on failure, error_code and the returned message describe why
+static const char* scan_rational(std::string_view str, uint64_t& numerator, uint32_t& denominator, bool& is_negate, size_t& error_code) noexcept {
+	numerator = 0;
+	denominator = 1;
+	is_negate = false;
 
-	bool is_negate = false;
 	bool decimal_detected = false;
-	for (size_t i = 0; i < str.size(); i++) {
-		char c = str.at(i);
+	for (char c : str) {
 		if (c >= '0' && c <= '9') {
 			if (numerator > UINT64_MAX / 10) {
-				panic("Overflow: Numerator is too large while parsing rational.", ERROR_OVERFLOW);
+				error_code = ERROR_OVERFLOW;
+				return "Overflow: Numerator is too large while parsing rational.";
 			}
 
 			numerator *= 10;
@@ -200,28 +201,57 @@ instance::value instance::parse_rational(std::string str) const {
 
 			if (decimal_detected) {
 				if (denominator > UINT32_MAX / 10) {
-					panic("Overflow: Denominator is too large while parsing rational.", ERROR_OVERFLOW);
+					error_code = ERROR_OVERFLOW;
+					return "Overflow: Denominator is too large while parsing rational.";
 				}
 				denominator *= 10;
 			}
 		}
 		else if (c == '.') {
 			if (decimal_detected) {
-				panic("Format: Two decimals detected.", ERROR_INVALID_ARGUMENT);
+				error_code = ERROR_INVALID_ARGUMENT;
+				return "Format: Two decimals detected.";
 			}
 
 			decimal_detected = true;
 		}
 		else if (c == '-') {
 			if (is_negate) {
-				panic("Format: Two negates detected.", ERROR_INVALID_ARGUMENT);
+				error_code = ERROR_INVALID_ARGUMENT;
+				return "Format: Two negates detected.";
 			}
 			is_negate = true;
 		}
 		else {
-			panic("Format: Must be digit (0-9).", ERROR_INVALID_ARGUMENT);
+			error_code = ERROR_INVALID_ARGUMENT;
+			return "Format: Must be digit (0-9).";
 		}
 	}
+	return nullptr;
+}
+
+instance::value instance::parse_rational(std::string str) const {
+	uint64_t numerator;
+	uint32_t denominator;
+	bool is_negate;
+	size_t error_code;
+	const char* error = scan_rational(str, numerator, denominator, is_negate, error_code);
+	if (error != nullptr) {
+		panic(error, error_code);
+	}
+
+	size_t common = gcd(denominator, numerator);
+	return value(value::vtype::RATIONAL, is_negate ? value::vflags::RATIONAL_IS_NEGATIVE : value::vflags::NONE, denominator / common, numerator / common);
+}
+
+std::optional<instance::value> instance::try_parse_rational(std::string_view str) const noexcept {
+	uint64_t numerator;
+	uint32_t denominator;
+	bool is_negate;
+	size_t error_code;
+	if (scan_rational(str, numerator, denominator, is_negate, error_code) != nullptr) {
+		return std::nullopt;
+	}
 
 	size_t common = gcd(denominator, numerator);
 	return value(value::vtype::RATIONAL, is_negate ? value::vflags::RATIONAL_IS_NEGATIVE : value::vflags::NONE, denominator / common, numerator / common);
@@ -1,3 +1,6 @@
+#include <fstream>
+#include <filesystem>
+#include <mutex>
 #include "HulaScript.hpp"
 #include "HulaScript.hpp"
 
@@ -15,15 +18,30 @@ void instance::finalize() {
 	top_level_local_vars.erase(top_level_local_vars.begin() + declared_top_level_locals, top_level_local_vars.end());
 	global_vars.erase(global_vars.begin() + globals.size(), global_vars.end());
 	local_offset = 0;
+	call_depth = 0;
 	
-	garbage_collect(true);
+	for (auto code : top_level_code) {
+		release_code(code.first, code.second);
+	}
+	top_level_code.clear();
+	release_retired_code();
+	ip = instructions.size();
+
+	//collecting after every run is wasted on small commands, so wait until enough was allocated
+	if (allocated_since_collect >= post_run_collect_threshold) {
+		garbage_collect();
+	}
 }
 
-std::variant<instance::value, std::vector<compilation_error>, std::monostate> instance::run(std::string source, std::optional<std::string> file_name, bool repl_mode) {
-	tokenizer tokenizer(source, file_name);
+std::variant<instance::value, std::vector<compilation_error>, std::monostate> instance::run(std::string source, std::optional<std::string> file_name, bool repl_mode, uint8_t optimization_level) {
+	//lazy functions are tokenized again when they're called, so they keep the source alive
+	auto shared_source = std::make_shared<const std::string>(std::move(source));
+	tokenizer tokenizer(*shared_source, file_name);
 
 	compilation_context context = {
 		.mode = (repl_mode ? compile_mode::COMPILE_MODE_REPL : compile_mode::COMPILE_MODE_NORMAL),
+		.optimization_level = optimization_level,
+		.lazy_source = lazy_compile_enabled ? shared_source : nullptr,
 		.tokenizer = tokenizer
 	};
 	
@@ -31,7 +49,7 @@ std::variant<instance::value, std::vector<compilation_error>, std::monostate> in
 		compile(context);
 	}
 	catch (...) {
-		garbage_collect(true);
+		garbage_collect();
 		throw;
 	}
 
@@ -46,11 +64,15 @@ std::variant<instance::value, std::vector<compilation_error>, std::monostate> in
 	return std::monostate{};
 }
 
-std::optional<instance::value> instance::run_no_warnings(std::string source, std::optional<std::string> file_name, bool repl_mode) {
-	tokenizer tokenizer(source, file_name);
+std::optional<instance::value> instance::run_no_warnings(std::string source, std::optional<std::string> file_name, bool repl_mode, uint8_t optimization_level) {
+	//lazy functions are tokenized again when they're called, so they keep the source alive
+	auto shared_source = std::make_shared<const std::string>(std::move(source));
+	tokenizer tokenizer(*shared_source, file_name);
 
 	compilation_context context = {
 		.mode = (repl_mode ? compile_mode::COMPILE_MODE_REPL : compile_mode::COMPILE_MODE_NORMAL),
+		.optimization_level = optimization_level,
+		.lazy_source = lazy_compile_enabled ? shared_source : nullptr,
 		.tokenizer = tokenizer
 	};
 
@@ -58,7 +80,7 @@ std::optional<instance::value> instance::run_no_warnings(std::string source, std
 		compile(context);
 	}
 	catch (...) {
-		garbage_collect(true);
+		garbage_collect();
 		//finalize();
 		throw;
 	}
@@ -91,34 +113,93 @@ std::optional<instance::value> instance::run_loaded() {
 	}
 }
 
-instance::value instance::load_module_from_source(std::string source, std::string file_name)
-{
-	size_t hash = Hash::dj2b(file_name.c_str());
-	if (loaded_modules.contains(hash)) {
-		return value(value::vtype::TABLE, value::vflags::TABLE_IS_MODULE, 0, loaded_modules.at(hash));
+//reads a whole file with a single read, so the tokenizer can view it without further copies
+static std::optional<std::string> read_file(const std::string& path) {
+	std::ifstream infile(path, std::ios::binary | std::ios::ate);
+	if (infile.fail()) {
+		return std::nullopt;
+	}
+	std::string contents(static_cast<size_t>(infile.tellg()), '\0');
+	infile.seekg(0);
+	if (!infile.read(contents.data(), contents.size())) {
+		return std::nullopt;
+	}
+	return contents;
+}
+
+//compiled modules shared by every instance in the process, keyed by canonical path
+struct shared_module {
+	std::filesystem::file_time_type modified;
+	size_t source_hash;
+	std::shared_ptr<const std::string> bytecode;
+};
+static std::mutex shared_modules_mutex;
+static phmap::flat_hash_map<std::string, shared_module> shared_modules;
+
+bool instance::prepare_module(std::string_view source, const std::string& file_name, size_t module_hash, std::string* bytecode) {
+	//the cache sits next to the module; a .hs module caches to .hsc
+	size_t source_hash = Hash::dj2b(source.data(), source.size());
+	std::string cache_path = file_name.ends_with(".hs") ? (file_name + "c") : (file_name + ".hsc");
+
+	if (module_cache_enabled) {
+		auto cached = read_file(cache_path);
+		if (cached.has_value() && link_module(cached.value(), source_hash, module_hash)) {
+			if (bytecode != nullptr) {
+				*bytecode = std::move(cached.value());
+			}
+			return true;
+		}
+	}
+
+	size_t old_global_size = globals.size();
+	size_t old_top_level_size = top_level_local_vars.size();
+
+	//a module that gets serialized must have every function compiled
+	std::shared_ptr<const std::string> lazy_source;
+	if (lazy_compile_enabled && !module_cache_enabled && bytecode == nullptr) {
+		lazy_source = std::make_shared<const std::string>(source);
+		source = *lazy_source;
 	}
 
 	tokenizer tokenizer(source, file_name);
 	compilation_context context = {
 		.mode = compile_mode::COMPILE_MODE_LIBRARY,
-		.parent_module = hash,
+		.parent_module = module_hash,
+		.lazy_source = lazy_source,
 		.tokenizer = tokenizer
 	};
 
-	size_t old_ip = ip;
-	size_t old_global_size = globals.size();
-	size_t old_top_level_size = top_level_local_vars.size();
-
 	try {
 		compile(context);
 	}
 	catch (...) {
 		global_vars.erase(global_vars.begin() + old_global_size, global_vars.end());
 		top_level_local_vars.erase(top_level_local_vars.begin() + old_top_level_size, top_level_local_vars.end());
-		garbage_collect(false);
-		return instance::value();
+		garbage_collect();
+		return false;
 	}
 
+	if (module_cache_enabled || bytecode != nullptr) {
+		auto serialized = serialize_module(source_hash, module_hash, top_level_code.back());
+		if (serialized.has_value()) {
+			if (module_cache_enabled) {
+				save_module_cache(cache_path, serialized.value());
+			}
+			if (bytecode != nullptr) {
+				*bytecode = std::move(serialized.value());
+			}
+		}
+	}
+	return true;
+}
+
+instance::value instance::run_module(size_t old_ip) {
+	size_t old_global_size = globals.size();
+	size_t old_top_level_size = top_level_local_vars.size();
+
+	auto module_code = top_level_code.back();
+	top_level_code.pop_back();
+
 	try {
 		execute();
 		
@@ -128,19 +209,129 @@ instance::value instance::load_module_from_source(std::string source, std::strin
 
 		global_vars.erase(global_vars.begin() + old_global_size, global_vars.end());
 		top_level_local_vars.erase(top_level_local_vars.begin() + old_top_level_size, top_level_local_vars.end());
-		garbage_collect(false);
+		ip = old_ip;
+		release_code(module_code.first, module_code.second);
+		garbage_collect();
 
 		temp_gc_exempt.pop_back();
-
-		ip = old_ip;
 		return toret;
 	}
 	catch (...) {
 		global_vars.erase(global_vars.begin() + old_global_size, global_vars.end());
 		top_level_local_vars.erase(top_level_local_vars.begin() + old_top_level_size, top_level_local_vars.end());
-		garbage_collect(false);
+		ip = old_ip;
+		release_code(module_code.first, module_code.second);
+		garbage_collect();
+		return instance::value();
+	}
+}
+
+instance::value instance::load_module_from_source(std::string_view source, std::string file_name)
+{
+	size_t hash = Hash::dj2b(file_name.c_str());
+	if (loaded_modules.contains(hash)) {
+		return value(value::vtype::TABLE, value::vflags::TABLE_IS_MODULE, 0, loaded_modules.at(hash));
+	}
+
+	size_t old_ip = ip;
+	if (!prepare_module(source, file_name, hash, nullptr)) {
 		return instance::value();
 	}
+	return run_module(old_ip);
+}
+
+//a module file's canonical path and when it was last modified
+static std::optional<std::pair<std::string, std::filesystem::file_time_type>> locate_module(const std::string& path) {
+	std::error_code error;
+	std::filesystem::path canonical_path = std::filesystem::canonical(path, error);
+	if (error) { //file probably not found
+		return std::nullopt;
+	}
+	auto modified = std::filesystem::last_write_time(canonical_path, error);
+	if (error) {
+		return std::nullopt;
+	}
+	return std::make_pair(canonical_path.string(), modified);
+}
+
+static std::optional<shared_module> find_shared_module(const std::string& file_name, std::filesystem::file_time_type modified) {
+	std::lock_guard<std::mutex> guard(shared_modules_mutex);
+	auto it = shared_modules.find(file_name);
+	if (it != shared_modules.end() && it->second.modified == modified) {
+		return it->second;
+	}
+	return std::nullopt;
+}
+
+static void share_module(const std::string& file_name, std::filesystem::file_time_type modified, const std::string& source, std::string&& bytecode) {
+	std::lock_guard<std::mutex> guard(shared_modules_mutex);
+	shared_modules.insert_or_assign(file_name, shared_module{
+		.modified = modified,
+		.source_hash = Hash::dj2b(source.data(), source.size()),
+		.bytecode = std::make_shared<const std::string>(std::move(bytecode))
+	});
+}
+
+instance::value instance::load_module_from_file(std::string path) {
+	auto location = locate_module(path);
+	if (!location.has_value()) {
+		return instance::value();
+	}
+	auto& [file_name, modified] = location.value();
+
+	size_t hash = Hash::dj2b(file_name.c_str());
+	if (loaded_modules.contains(hash)) {
+		return value(value::vtype::TABLE, value::vflags::TABLE_IS_MODULE, 0, loaded_modules.at(hash));
+	}
+
+	size_t old_ip = ip;
+	//another instance already compiled an unmodified copy, so neither the file nor the compiler is touched
+	auto shared = find_shared_module(file_name, modified);
+	if (shared.has_value() && link_module(*shared.value().bytecode, shared.value().source_hash, hash)) {
+		return run_module(old_ip);
+	}
+
+	auto source = read_file(file_name);
+	if (!source.has_value()) {
+		return instance::value();
+	}
+
+	//lazily compiled modules can't be shared, since their functions aren't compiled yet
+	std::string bytecode;
+	if (!prepare_module(source.value(), file_name, hash, (lazy_compile_enabled && !module_cache_enabled) ? nullptr : &bytecode)) {
+		return instance::value();
+	}
+	if (!bytecode.empty()) {
+		share_module(file_name, modified, source.value(), std::move(bytecode));
+	}
+	return run_module(old_ip);
+}
+
+bool instance::compile_module_file(std::string path) const {
+	auto location = locate_module(path);
+	if (!location.has_value()) {
+		return false;
+	}
+	auto& [file_name, modified] = location.value();
+	if (find_shared_module(file_name, modified).has_value()) {
+		return true;
+	}
+
+	auto source = read_file(file_name);
+	if (!source.has_value()) {
+		return false;
+	}
+
+	//the serialized module only holds local constant and function indices, so it links into any instance
+	instance compiler(numerical_parser);
+	compiler.set_module_cache(module_cache_enabled);
+
+	std::string bytecode;
+	if (!compiler.prepare_module(source.value(), file_name, Hash::dj2b(file_name.c_str()), &bytecode) || bytecode.empty()) {
+		return false;
+	}
+	share_module(file_name, modified, source.value(), std::move(bytecode));
+	return true;
 }
 
 instance::value instance::invoke_value(value to_call, std::vector<value> arguments) {
@@ -156,6 +347,51 @@ instance::value instance::invoke_value(value to_call, std::vector<value> argumen
 	return to_return;
 }
 
+instance::script_handle instance::prepare(std::string source, std::vector<std::string> parameters, std::optional<std::string> file_name) {
+	tokenizer tokenizer(source, file_name);
+
+	compilation_context context = {
+		.mode = compile_mode::COMPILE_MODE_NORMAL,
+		.tokenizer = tokenizer
+	};
+
+	uint32_t id;
+	try {
+		id = compile_prepared(context, parameters);
+	}
+	catch (...) {
+		garbage_collect();
+		throw;
+	}
+	return script_handle(*this, value(value::vtype::CLOSURE, value::vflags::NONE, id, 0));
+}
+
+instance::value instance::execute_prepared(value script, std::vector<value> arguments) {
+	size_t old_ip = ip;
+	size_t old_local_offset = local_offset;
+	size_t eval_stack_size = evaluation_stack.size();
+	size_t locals_size = locals.size();
+	size_t return_stack_size = return_stack.size();
+	size_t extended_offsets_size = extended_offsets.size();
+
+	value result;
+	try {
+		result = invoke_value(script, arguments);
+	}
+	catch (...) {
+		ip = old_ip;
+		local_offset = old_local_offset;
+		evaluation_stack.erase(evaluation_stack.begin() + eval_stack_size, evaluation_stack.end());
+		locals.erase(locals.begin() + locals_size, locals.end());
+		return_stack.erase(return_stack.begin() + return_stack_size, return_stack.end());
+		extended_offsets.erase(extended_offsets.begin() + extended_offsets_size, extended_offsets.end());
+		release_retired_code();
+		throw;
+	}
+	release_retired_code();
+	return result;
+}
+
 instance::value instance::invoke_method(value object, std::string method_name, std::vector<value> arguments) {
 	evaluation_stack.push_back(object);
 	evaluation_stack.push_back(value(value::vtype::INTERNAL_STRHASH, 0, 0, Hash::dj2b(method_name.c_str())));
@@ -1,6 +1,7 @@
 #include <ctype.h>
 #include <sstream>
-#include "hash.hpp"
+#include <array>
+#include <charconv>
 #include "tokenizer.hpp"
 
 using namespace HulaScript;
@@ -14,6 +15,7 @@ char tokenizer::scan_char() {
 		current_col++;
 	}
 
+	char_pos = pos;
 	if (pos == source.size()) {
 		return last_char = '\0';
 	}
@@ -23,6 +25,64 @@ char tokenizer::scan_char() {
 	return last_char;
 }
 
+namespace {
+	struct keyword {
+		std::string_view text;
+		token_type type;
+	};
+
+	static constexpr keyword keywords[] = {
+		{ "true", token_type::TRUE_TOK },
+		{ "false", token_type::FALSE_TOK },
+		{ "nil", token_type::NIL },
+		{ "function", token_type::FUNCTION },
+		{ "array", token_type::TABLE },
+		{ "class", token_type::CLASS },
+		{ "if", token_type::IF },
+		{ "else", token_type::ELSE },
+		{ "elif", token_type::ELIF },
+		{ "while", token_type::WHILE },
+		{ "for", token_type::FOR },
+		{ "try", token_type::TRY },
+		{ "catch", token_type::CATCH },
+		{ "in", token_type::IN_TOK },
+		{ "do", token_type::DO },
+		{ "return", token_type::RETURN },
+		{ "break", token_type::LOOP_BREAK },
+		{ "continue", token_type::LOOP_CONTINUE },
+		{ "then", token_type::THEN },
+		{ "end", token_type::END_BLOCK },
+		{ "global", token_type::GLOBAL },
+		{ "table", token_type::TABLE },
+		{ "no_capture", token_type::NO_CAPTURE },
+		{ "variadic", token_type::VARIADIC }
+	};
+
+	//perfect hash of the keywords above: no two of them share a slot, so a lookup is one probe and one comparison
+	static constexpr size_t KEYWORD_SLOTS = 64;
+	static constexpr size_t keyword_slot(std::string_view text) noexcept {
+		return (static_cast<unsigned char>(text.front()) * 7 + static_cast<unsigned char>(text.back()) * 2 + text.size()) & (KEYWORD_SLOTS - 1);
+	}
+
+	static constexpr std::array<keyword, KEYWORD_SLOTS> keyword_table = [] {
+		std::array<keyword, KEYWORD_SLOTS> table = { };
+		for (auto& kw : keywords) {
+			table[keyword_slot(kw.text)] = kw;
+		}
+		return table;
+	}();
+
+	static constexpr bool keyword_hash_is_perfect() {
+		for (auto& kw : keywords) {
+			if (keyword_table[keyword_slot(kw.text)].text != kw.text) {
+				return false;
+			}
+		}
+		return true;
+	}
+	static_assert(keyword_hash_is_perfect(), "Two keywords share a slot; adjust keyword_slot.");
+}
+
 char tokenizer::scan_literal_char() {
 	if (last_char == '\\') {
 		scan_char();
@@ -90,117 +150,80 @@ token tokenizer::scan_token() {
 	last_tok_col = current_col;
 	last_tok_row = current_row;
 	if (std::isalpha(last_char) || last_char == '@') {
-		std::stringstream ss;
+		size_t start = char_pos;
 		if (last_char == '@') {
-			ss << '@';
 			scan_char();
 		}
 
 		while (std::isalnum(last_char) || last_char == '_')
 		{
-			ss << last_char;
 			scan_char();
 		}
 		
-		size_t hash = Hash::dj2b(ss.str().c_str());
-		switch (hash)
-		{
-		case Hash::dj2b("true"):
-			return last_token = token(token_type::TRUE_TOK);
-		case Hash::dj2b("false"):
-			return last_token = token(token_type::FALSE_TOK);
-		case Hash::dj2b("nil"):
-			return last_token = token(token_type::NIL);
-		case Hash::dj2b("function"):
-			return last_token = token(token_type::FUNCTION);
-		case Hash::dj2b("array"):
-			return last_token = token(token_type::TABLE);
-		case Hash::dj2b("class"):
-			return last_token = token(token_type::CLASS);
-		case Hash::dj2b("if"):
-			return last_token = token(token_type::IF);
-		case Hash::dj2b("else"):
-			return last_token = token(token_type::ELSE);
-		case Hash::dj2b("elif"):
-			return last_token = token(token_type::ELIF);
-		case Hash::dj2b("while"):
-			return last_token = token(token_type::WHILE);
-		case Hash::dj2b("for"):
-			return last_token = token(token_type::FOR);
-		case Hash::dj2b("try"):
-			return last_token = token(token_type::TRY);
-		case Hash::dj2b("catch"):
-			return last_token = token(token_type::CATCH);
-		case Hash::dj2b("in"):
-			return last_token = token(token_type::IN_TOK);
-		case Hash::dj2b("do"):
-			return last_token = token(token_type::DO);
-		case Hash::dj2b("return"):
-			return last_token = token(token_type::RETURN);
-		case Hash::dj2b("break"):
-			return last_token = token(token_type::LOOP_BREAK);
-		case Hash::dj2b("continue"):
-			return last_token = token(token_type::LOOP_CONTINUE);
-		case Hash::dj2b("then"):
-			return last_token = token(token_type::THEN);
-		case Hash::dj2b("end"):
-			return last_token = token(token_type::END_BLOCK);
-		case Hash::dj2b("global"):
-			return last_token = token(token_type::GLOBAL);
-		case Hash::dj2b("table"):
-			return last_token = token(token_type::TABLE);
-		case Hash::dj2b("no_capture"):
-			return last_token = token(token_type::NO_CAPTURE);
-		case Hash::dj2b("variadic"):
-			return last_token = token(token_type::VARIADIC);
-		default:
-			return last_token = token(ss.str());
+		std::string_view identifier = source.substr(start, char_pos - start);
+		const keyword& kw = keyword_table[keyword_slot(identifier)];
+		if (kw.text == identifier) {
+			return last_token = token(kw.type);
 		}
+		return last_token = token(token_type::IDENTIFIER, identifier);
 	}
 	else if (last_char == '\"') {
 		scan_char();
 
-		std::stringstream ss;
+		//literals without escapes are views into the source; only the rest are decoded into a copy
+		size_t start = char_pos;
+		while (last_char != '\"' && last_char != '\\') {
+			if (last_char == '\0') {
+				panic("Syntax Error: Unexpected End Of Source in string literal.");
+			}
+			scan_char();
+		}
+		if (last_char == '\"') {
+			std::string_view literal = source.substr(start, char_pos - start);
+			scan_char();
+			return last_token = token(token_type::STRING_LITERAL, literal);
+		}
+
+		std::string decoded(source.substr(start, char_pos - start));
 		while (last_char != '\"') {
 			if (last_char == '\0') {
 				panic("Syntax Error: Unexpected End Of Source in string literal.");
 			}
 
-			ss << scan_literal_char();
+			decoded.push_back(scan_literal_char());
 		}
 		scan_char();
-		return last_token = token(token_type::STRING_LITERAL, ss.str());
+		return last_token = token(token_type::STRING_LITERAL, std::move(decoded));
 	}
 	else if (std::isdigit(last_char)) {
-		std::stringstream ss;
+		size_t start = char_pos;
 		do {
-			ss << last_char;
 			scan_char();
 		} while (std::isdigit(last_char) || last_char == '.');
+		std::string_view numerical = source.substr(start, char_pos - start);
 
-		try {
-			double num = std::stod(ss.str());
-
-			if (last_char == 'f') {
-				scan_char();
-				return last_token = token(num);
-			}
-			else if (last_char == 'r') {
-				scan_char();
-				return last_token = token(token_type::RATIONAL, ss.str());
-			}
-			return last_token = token(token_type::NUMBER_CUSTOM, ss.str());
+		double num;
+		auto res = std::from_chars(numerical.data(), numerical.data() + numerical.size(), num);
+		if (res.ec == std::errc::result_out_of_range) {
+			std::stringstream ss;
+			ss << "Numerical Error: Number \"" << numerical << "\" is far to big.";
+			panic(ss.str());
+		}
+		else if (res.ec != std::errc()) {
+			std::stringstream ss;
+			ss << "Numerical Error: Cannot parse numerical string \"" << numerical << "\".";
+			panic(ss.str());
 		}
-		catch(std::invalid_argument) {
-			std::stringstream ss2;
-			ss2 << "Numerical Error: Cannot parse numerical string \"" << ss.str() << "\".";
-			panic(ss2.str());
+
+		if (last_char == 'f') {
+			scan_char();
+			return last_token = token(num);
 		}
-		catch (std::out_of_range) {
-			std::stringstream ss2;
-			ss2 << "Numerical Error: Number \"" << ss.str() << "\" is far to big.";
-			panic(ss2.str());
+		else if (last_char == 'r') {
+			scan_char();
+			return last_token = token(token_type::RATIONAL, numerical);
 		}
+		return last_token = token(token_type::NUMBER_CUSTOM, numerical);
 	}
 	else {
 		char switch_char = last_char;
@@ -288,4 +311,60 @@ token tokenizer::scan_token() {
 		}
 		}
 	}
+}
+
+void tokenizer::skip_block() {
+	//a header (for, while or function) waits for the do that opens it's body; a do that doesn't follow a header starts a do-while loop
+	enum block_kind {
+		BLOCK_END,
+		BLOCK_DO_WHILE,
+		BLOCK_HEADER
+	};
+
+	std::vector<block_kind> blocks = { block_kind::BLOCK_END };
+	for (;;) {
+		switch (last_token.type())
+		{
+		case token_type::END_OF_SOURCE:
+			expect_token(token_type::END_BLOCK);
+			break;
+		case token_type::IF:
+		case token_type::TRY:
+		case token_type::CLASS:
+			blocks.push_back(block_kind::BLOCK_END);
+			break;
+		case token_type::FOR:
+		case token_type::FUNCTION:
+			blocks.push_back(block_kind::BLOCK_HEADER);
+			break;
+		case token_type::WHILE:
+			if (blocks.back() == block_kind::BLOCK_DO_WHILE) {
+				blocks.pop_back();
+			}
+			else {
+				blocks.push_back(block_kind::BLOCK_HEADER);
+			}
+			break;
+		case token_type::DO:
+			if (blocks.back() == block_kind::BLOCK_HEADER) {
+				blocks.back() = block_kind::BLOCK_END;
+			}
+			else {
+				blocks.push_back(block_kind::BLOCK_DO_WHILE);
+			}
+			break;
+		case token_type::END_BLOCK:
+			if (blocks.back() != block_kind::BLOCK_END) {
+				unexpected_token();
+			}
+			blocks.pop_back();
+			if (blocks.empty()) {
+				return;
+			}
+			break;
+		default:
+			break;
+		}
+		scan_token();
+	}
 }
\ No newline at end of file
@@ -74,6 +74,7 @@ namespace HulaScript {
 				TABLE_ARRAY_ITERATE = 8,
 				IS_NUMERICAL = 64,
 				RATIONAL_IS_NEGATIVE = 128,
+				STRING_IS_INLINE = 512,
 			};
 
 			uint16_t flags;
@@ -91,6 +92,14 @@ namespace HulaScript {
 
 			value(vtype t, uint16_t flags, uint32_t function_id, size_t data) : type(t), flags(flags), function_id(function_id), data({ .id = data }) { }
 
+			//short strings are stored inline in function_id and data, and are always null terminated
+			const char* c_str() const noexcept {
+				if (flags & vflags::STRING_IS_INLINE) {
+					return reinterpret_cast<const char*>(&function_id);
+				}
+				return data.str;
+			}
+
 			friend class instance;
 		public:
 			value() : value(vtype::NIL, vflags::NONE, 0, 0) { }
@@ -126,7 +135,7 @@ namespace HulaScript {
 
 			std::string str(instance& instance) const {
 				expect_type(vtype::STRING, instance);
-				return std::string(data.str);
+				return std::string(c_str());
 			}
 
 			size_t size(instance& instance) const {
@@ -166,10 +175,10 @@ namespace HulaScript {
 					break;
 				case vtype::STRING: {
 					if constexpr (IsTableHash) {
-						return Hash::dj2b(data.str);
+						return Hash::dj2b(c_str());
 					}
 					else {
-						payload = Hash::dj2b(data.str);
+						payload = Hash::dj2b(c_str());
 						break;
 					}
 				}
@@ -230,7 +239,23 @@ namespace HulaScript {
 				return (size_t)this;
 			}
 
+			//only called on objects tagged GC_KIND_WEAK, after marking; drops every held value is_alive reports as dead
+			virtual void clear_dead_references(const std::function<bool(const value&)>& is_alive) { }
+
+			enum gc_kind : uint8_t {
+				GC_KIND_OBJECT,
+				GC_KIND_IMPORTED_LIBRARY,
+				GC_KIND_POOLED,
+				GC_KIND_WEAK
+			};
+			gc_kind gc_tag = gc_kind::GC_KIND_OBJECT;
+
 			friend struct value;
+		private:
+			//mirrors the garbage collector's registry header in the interpreter's foreign_object
+			foreign_object* gc_next = nullptr;
+			uint32_t gc_mark = 0;
+			uint8_t gc_pool_class = 0;
 		public:
 			virtual ~foreign_object() = default;
 		};
@@ -261,6 +286,86 @@ namespace HulaScript {
 
 		virtual void temp_gc_unprotect() = 0;
 
+		virtual uint32_t add_root(value val) = 0;
+		virtual void remove_root(uint32_t slot) = 0;
+		virtual value& root_at(uint32_t slot) = 0;
+
+		//keeps a value alive until the end of the enclosing scope
+		class local_handle {
+		public:
+			local_handle(instance& owner_instance, value val) : owner_instance(owner_instance), slot(owner_instance.add_root(val)) { }
+
+			local_handle(const local_handle& other) = delete;
+			local_handle& operator=(const local_handle& other) = delete;
+			static void* operator new(size_t size) = delete;
+
+			~local_handle() {
+				owner_instance.remove_root(slot);
+			}
+
+			value get() const {
+				return owner_instance.root_at(slot);
+			}
+
+			void set(value val) {
+				owner_instance.root_at(slot) = val;
+			}
+		private:
+			instance& owner_instance;
+			uint32_t slot;
+		};
+
+		//keeps a value alive until the handle is reset or destroyed; it can be moved and stored, and must not outlive its instance
+		class persistent_handle {
+		public:
+			persistent_handle() : owner_instance(nullptr), slot(0) { }
+			persistent_handle(instance& owner_instance, value val) : owner_instance(&owner_instance), slot(owner_instance.add_root(val)) { }
+
+			persistent_handle(persistent_handle&& other) noexcept : owner_instance(other.owner_instance), slot(other.slot) {
+				other.owner_instance = nullptr;
+			}
+
+			persistent_handle& operator=(persistent_handle&& other) noexcept {
+				if (this != &other) {
+					reset();
+					owner_instance = other.owner_instance;
+					slot = other.slot;
+					other.owner_instance = nullptr;
+				}
+				return *this;
+			}
+
+			persistent_handle(const persistent_handle& other) = delete;
+			persistent_handle& operator=(const persistent_handle& other) = delete;
+
+			~persistent_handle() {
+				reset();
+			}
+
+			bool empty() const noexcept {
+				return owner_instance == nullptr;
+			}
+
+			value get() const {
+				return empty() ? value() : owner_instance->root_at(slot);
+			}
+
+			void set(value val) {
+				assert(!empty());
+				owner_instance->root_at(slot) = val;
+			}
+
+			void reset() {
+				if (owner_instance != nullptr) {
+					owner_instance->remove_root(slot);
+					owner_instance = nullptr;
+				}
+			}
+		private:
+			instance* owner_instance;
+			uint32_t slot;
+		};
+
 	private:
 		using operand = uint8_t;
 
@@ -299,6 +404,7 @@ namespace HulaScript {
 			ALLOCATE_INHERITED_CLASS,
 			ALLOCATE_MODULE,
 			FINALIZE_TABLE,
+			RELEASE_LOCAL_TABLE,
 			LOAD_MODULE,
 			STORE_MODULE,
 